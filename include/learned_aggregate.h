@@ -0,0 +1,355 @@
+#pragma once
+
+/**
+ * @file learned_aggregate.h
+ * @brief Aggregations over numerical keys (equi-depth histograms, counts and
+ * sums grouped by key) that use the CDF model of Learned Sort to partition the
+ * keys, instead of sorting them.
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo <anikristo@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <memory_resource>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "learned_sort.h"
+#include "rmi.h"
+#include "utils.h"
+
+namespace learned_sort {
+
+// A bin of a histogram, which holds `count` keys in [min_key, max_key]
+template <class T>
+struct histogram_bin {
+  T min_key;
+  T max_key;
+  long count;
+};
+
+/**
+ * @brief Trains a CDF model on [begin, end) for an aggregation, if the input
+ * is large enough for Learned Sort to use one.
+ *
+ * @return Whether the model was trained
+ */
+template <class RandomIt>
+bool train_for_aggregation(
+    RandomIt begin, RandomIt end,
+    TwoLayerRMI<typename std::iterator_traits<RandomIt>::value_type> &rmi) {
+  const long min_sz = std::max<long>(rmi.hp.fanout * rmi.hp.threshold,
+                                     5 * rmi.hp.num_leaf_models);
+  return std::distance(begin, end) > min_sz && rmi.train(begin, end);
+}
+
+/**
+ * @brief Builds an equi-depth histogram of the keys in [begin, end), without
+ * sorting or moving them.
+ *
+ * The keys are counted in PRIMARY_FANOUT * SECONDARY_FANOUT fine buckets, which
+ * are the buckets that Learned Sort would place them in after its secondary
+ * partitioning step, and the consecutive fine buckets are grouped into bins of
+ * about the same depth. The counts and the key ranges of the bins are exact
+ * for the keys that they hold, while their depths are only as even as the fine
+ * buckets allow. Inputs on which no CDF model can be trained are sorted in a
+ * buffer instead, which gives exactly even bins.
+ *
+ * @param num_bins The number of bins. Fewer bins are returned when there are
+ * fewer keys, or when a fine bucket is deeper than a bin.
+ * @param resource The memory resource for the CDF model and the auxiliary
+ * buffers. Defaults to the one set with utils::set_scratch_resource().
+ * @return The non-empty bins, in ascending order of their keys
+ */
+template <class RandomIt>
+std::vector<histogram_bin<typename std::iterator_traits<RandomIt>::value_type>>
+equi_depth_histogram(RandomIt begin, RandomIt end, long num_bins,
+                     std::pmr::memory_resource *resource =
+                         learned_sort::utils::scratch_resource()) {
+  // Determine the data type
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+
+  const long input_sz = std::distance(begin, end);
+  std::vector<histogram_bin<T>> bins;
+  if (input_sz == 0 || num_bins <= 0) return bins;
+
+  typename TwoLayerRMI<T>::Params params;
+  TwoLayerRMI<T> rmi(params, resource);
+  if (!train_for_aggregation(begin, end, rmi)) {
+    // Fall back to cutting the sorted keys into equal parts
+    std::pmr::vector<T> keys(begin, end, resource);
+    std::sort(keys.begin(), keys.end());
+    for (long bin_idx = 0; bin_idx < num_bins; ++bin_idx) {
+      const long bin_start = bin_idx * input_sz / num_bins;
+      const long bin_end = (bin_idx + 1) * input_sz / num_bins;
+      if (bin_start == bin_end) continue;
+      bins.push_back({keys[bin_start], keys[bin_end - 1], bin_end - bin_start});
+    }
+    return bins;
+  }
+
+  // Count the keys in each fine bucket, and record their key ranges
+  constexpr long NUM_FINE_BUCKETS = PRIMARY_FANOUT * SECONDARY_FANOUT;
+  std::pmr::vector<histogram_bin<T>> fine_buckets(NUM_FINE_BUCKETS,
+                                                  {T(), T(), 0}, resource);
+  for (auto it = begin; it != end; ++it) {
+    const T key = *it;
+    const long bucket_idx = static_cast<long>(
+        std::max(0., std::min(NUM_FINE_BUCKETS - 1.,
+                              rmi.predict(key) * NUM_FINE_BUCKETS)));
+    auto &bucket = fine_buckets[bucket_idx];
+    if (bucket.count++ == 0) {
+      bucket.min_key = bucket.max_key = key;
+    } else {
+      bucket.min_key = std::min(bucket.min_key, key);
+      bucket.max_key = std::max(bucket.max_key, key);
+    }
+  }
+
+  // Group the fine buckets into bins, closing a bin as soon as the keys seen
+  // so far reach its share of the input
+  long num_counted = 0;
+  long bin_idx = 0;
+  bool bin_closed = true;
+  for (const auto &bucket : fine_buckets) {
+    if (bucket.count == 0) continue;
+
+    if (bin_closed) {
+      bins.push_back(bucket);
+      bin_closed = false;
+    } else {
+      auto &bin = bins.back();
+      bin.min_key = std::min(bin.min_key, bucket.min_key);
+      bin.max_key = std::max(bin.max_key, bucket.max_key);
+      bin.count += bucket.count;
+    }
+    num_counted += bucket.count;
+
+    // Skip the bins that this bucket filled up
+    while (bin_idx < num_bins &&
+           num_counted >=
+               ((bin_idx + 1) * input_sz + num_bins - 1) / num_bins) {
+      ++bin_idx;
+      bin_closed = true;
+    }
+  }
+
+  return bins;
+}
+
+/**
+ * @brief Groups the keys in [begin, end) by their value, and counts the keys in
+ * each group, or sums their payloads if HasPayload is set, where the payload of
+ * the key at begin[i] is payload_begin[i]. The counts have the value type of
+ * PayloadIt, which is not dereferenced otherwise.
+ *
+ * The keys (and payloads) are scattered to the PRIMARY_FANOUT buckets that the
+ * CDF model predicts for them, as in the first partitioning step of Learned
+ * Sort, and each bucket is then ordered by the positions that the model
+ * predicts within it. Since the model predicts the same position for equal
+ * keys, every group is aggregated exactly from the keys at a single position.
+ * The keys of inputs on which no model can be trained, which are usually those
+ * with few distinct keys, are aggregated in a hash table instead. The input is
+ * not modified.
+ *
+ * @return The groups, as pairs of a key and its count or sum, in ascending
+ * order of their keys
+ */
+template <bool HasPayload, class RandomIt, class PayloadIt>
+auto aggregate_by_key(RandomIt begin, RandomIt end, PayloadIt payload_begin,
+                      std::pmr::memory_resource *resource) {
+  // Determine the data types
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  typedef typename std::iterator_traits<PayloadIt>::value_type V;
+  typedef std::pair<T, V> group_t;
+
+  // The keys are carried along with their payloads, if any
+  typedef std::conditional_t<HasPayload, group_t, T> entry_t;
+  auto key_of = [](const entry_t &entry) -> const T & {
+    if constexpr (HasPayload) {
+      return entry.first;
+    } else {
+      return entry;
+    }
+  };
+  auto value_of = [](const entry_t &entry) -> V {
+    if constexpr (HasPayload) {
+      return entry.second;
+    } else {
+      return 1;
+    }
+  };
+  auto entry_at = [&](long i) -> entry_t {
+    if constexpr (HasPayload) {
+      return {begin[i], payload_begin[i]};
+    } else {
+      return begin[i];
+    }
+  };
+  auto key_less = [](const auto &a, const auto &b) {
+    if constexpr (HasPayload) {
+      return a.first < b.first;
+    } else {
+      return a < b;
+    }
+  };
+  auto group_less = [](const group_t &a, const group_t &b) {
+    return a.first < b.first;
+  };
+
+  const long input_sz = std::distance(begin, end);
+  std::vector<group_t> groups;
+  if (input_sz == 0) return groups;
+
+  typename TwoLayerRMI<T>::Params params;
+  TwoLayerRMI<T> rmi(params, resource);
+  if (!train_for_aggregation(begin, end, rmi)) {
+    std::pmr::unordered_map<T, V> table(resource);
+    for (long i = 0; i < input_sz; ++i) {
+      const entry_t entry = entry_at(i);
+      table[key_of(entry)] += value_of(entry);
+    }
+    groups.assign(table.begin(), table.end());
+    std::sort(groups.begin(), groups.end(), group_less);
+    return groups;
+  }
+
+  // Scale the predicted CDF of the keys to the number of buckets
+  auto scaled_cdf = [&](const T &key) {
+    return std::max(0., std::min(PRIMARY_FANOUT - 1.,
+                                 rmi.predict(key) * PRIMARY_FANOUT));
+  };
+
+  // Count the keys in each bucket, and compute the bucket offsets
+  std::pmr::vector<long> bucket_offsets(PRIMARY_FANOUT + 1, 0, resource);
+  for (auto it = begin; it != end; ++it) {
+    ++bucket_offsets[static_cast<long>(scaled_cdf(*it)) + 1];
+  }
+  for (long bucket_idx = 1; bucket_idx <= PRIMARY_FANOUT; ++bucket_idx) {
+    bucket_offsets[bucket_idx] += bucket_offsets[bucket_idx - 1];
+  }
+
+  // Scatter the keys to the buckets
+  learned_sort::utils::scratch_buffer<entry_t> scattered(input_sz, resource);
+  long max_bucket_sz = 0;
+  {
+    std::pmr::vector<long> write_offsets(bucket_offsets.begin(),
+                                         bucket_offsets.end() - 1, resource);
+    for (long i = 0; i < input_sz; ++i) {
+      const entry_t entry = entry_at(i);
+      scattered.data()[write_offsets[static_cast<long>(
+          scaled_cdf(key_of(entry)))]++] = entry;
+    }
+    for (long bucket_idx = 0; bucket_idx < PRIMARY_FANOUT; ++bucket_idx) {
+      max_bucket_sz = std::max(max_bucket_sz, bucket_offsets[bucket_idx + 1] -
+                                                  bucket_offsets[bucket_idx]);
+    }
+  }
+
+  // Place the keys of each bucket at their predicted positions with a counting
+  // sort, as in the model-based counting sort of Learned Sort. The keys that
+  // share a position are then sorted, and the runs of equal keys are reduced.
+  learned_sort::utils::scratch_buffer<entry_t> bucket_buf(max_bucket_sz,
+                                                          resource);
+  std::pmr::vector<long> positions(max_bucket_sz, resource);
+  std::pmr::vector<long> position_offsets(max_bucket_sz + 1, resource);
+  for (long bucket_idx = 0; bucket_idx < PRIMARY_FANOUT; ++bucket_idx) {
+    const auto bucket = scattered.data() + bucket_offsets[bucket_idx];
+    const long bucket_sz =
+        bucket_offsets[bucket_idx + 1] - bucket_offsets[bucket_idx];
+    if (bucket_sz == 0) continue;
+
+    std::fill_n(position_offsets.begin(), bucket_sz + 1, 0);
+    for (long i = 0; i < bucket_sz; ++i) {
+      positions[i] = std::min(
+          bucket_sz - 1,
+          static_cast<long>((scaled_cdf(key_of(bucket[i])) - bucket_idx) *
+                            bucket_sz));
+      ++position_offsets[positions[i] + 1];
+    }
+    for (long pos = 1; pos <= bucket_sz; ++pos) {
+      position_offsets[pos] += position_offsets[pos - 1];
+    }
+    for (long i = 0; i < bucket_sz; ++i) {
+      bucket_buf.data()[position_offsets[positions[i]]++] = bucket[i];
+    }
+
+    // The offsets now point to the ends of the positions
+    long group_start = 0;
+    for (long pos = 0; pos < bucket_sz; ++pos) {
+      const auto first = bucket_buf.data() + group_start;
+      const auto last = bucket_buf.data() + position_offsets[pos];
+      group_start = position_offsets[pos];
+      if (last - first > 1) std::sort(first, last, key_less);
+
+      for (auto it = first; it != last; ++it) {
+        if (it == first || groups.back().first != key_of(*it)) {
+          groups.emplace_back(key_of(*it), value_of(*it));
+        } else {
+          groups.back().second += value_of(*it);
+        }
+      }
+    }
+  }
+
+  // Touch up the order of the groups, since the model is not guaranteed to be
+  // monotonic
+  learned_sort::utils::insertion_sort(groups.begin(), groups.end(),
+                                      group_less);
+  return groups;
+}
+
+/**
+ * @brief Counts the occurrences of every distinct key in [begin, end), without
+ * sorting or modifying the input (see aggregate_by_key()).
+ *
+ * @param resource The memory resource for the CDF model and the auxiliary
+ * buffers. Defaults to the one set with utils::set_scratch_resource().
+ * @return Pairs of a distinct key and its count, in ascending order of the keys
+ */
+template <class RandomIt>
+std::vector<
+    std::pair<typename std::iterator_traits<RandomIt>::value_type, long>>
+count_by_key(RandomIt begin, RandomIt end,
+             std::pmr::memory_resource *resource =
+                 learned_sort::utils::scratch_resource()) {
+  return aggregate_by_key<false>(begin, end, static_cast<long *>(nullptr),
+                                 resource);
+}
+
+/**
+ * @brief Sums the payloads that are attached to every distinct key, where the
+ * payload of the key at keys_begin[i] is payload_begin[i], without sorting or
+ * modifying the input (see aggregate_by_key()).
+ *
+ * @param resource The memory resource for the CDF model and the auxiliary
+ * buffers. Defaults to the one set with utils::set_scratch_resource().
+ * @return Pairs of a distinct key and the sum of its payloads, in ascending
+ * order of the keys
+ */
+template <class RandomIt, class PayloadIt>
+std::vector<
+    std::pair<typename std::iterator_traits<RandomIt>::value_type,
+              typename std::iterator_traits<PayloadIt>::value_type>>
+sum_by_key(RandomIt keys_begin, RandomIt keys_end, PayloadIt payload_begin,
+           std::pmr::memory_resource *resource =
+               learned_sort::utils::scratch_resource()) {
+  return aggregate_by_key<true>(keys_begin, keys_end, payload_begin, resource);
+}
+
+}  // namespace learned_sort
@@ -0,0 +1,307 @@
+#pragma once
+
+/**
+ * @file learned_index.h
+ * @brief A learned index over a sorted sequence of numerical keys, which reuses
+ * the CDF model that Learned Sort trained for sorting them.
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo <anikristo@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <memory_resource>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "learned_sort.h"
+#include "rmi.h"
+#include "utils.h"
+
+namespace learned_sort {
+
+/**
+ * @brief A read-only index over the keys in the sorted range [begin, end),
+ * which answers lower_bound() and equal_range() queries with a CDF model, one
+ * at a time or in batches.
+ *
+ * For every leaf model of the RMI, the index records the minimum and maximum
+ * difference between the actual and the predicted positions of the keys that
+ * the leaf is responsible for. A query is answered by a binary search within
+ * these bounds around the predicted position, which is only extended with an
+ * exponential search when the key is not in the input and falls outside of
+ * them. The range must not be modified while the index is in use.
+ */
+template <class RandomIt>
+class LearnedIndex {
+ public:
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+
+  /**
+   * @brief Builds the index over the sorted range [begin, end) in a single
+   * pass, which measures the error bounds of `model`. If `model` is not
+   * trained, a model is trained on the range, and if that fails too (e.g., for
+   * small ranges, or ones with few distinct keys), the queries fall back to
+   * binary search. The index allocates its memory from the model's resource.
+   */
+  LearnedIndex(RandomIt begin, RandomIt end, const TwoLayerRMI<T> &model)
+      : rmi(model.hp, model.resource),
+        min_errors(model.resource),
+        max_errors(model.resource),
+        first(begin),
+        last(end) {
+    rmi = model;
+
+    const long input_sz = std::distance(begin, end);
+    if (!rmi.trained &&
+        input_sz > std::max<long>(rmi.hp.fanout * rmi.hp.threshold,
+                                  5 * rmi.hp.num_leaf_models)) {
+      rmi.train(begin, end);
+    }
+    if (!rmi.trained) return;
+
+    // Measure the error bounds of every leaf model. The leaves without any
+    // keys keep empty bounds (i.e., min > max).
+    const long num_leaf_models = rmi.hp.num_leaf_models;
+    min_errors.assign(num_leaf_models, std::numeric_limits<long>::max());
+    max_errors.assign(num_leaf_models, std::numeric_limits<long>::min());
+    for (long i = 0; i < input_sz; ++i) {
+      const T key = begin[i];
+      const long leaf_idx = rmi.leaf_index(key);
+      const double pred_pos = rmi.predict(key) * input_sz;
+      min_errors[leaf_idx] = std::min(
+          min_errors[leaf_idx], static_cast<long>(std::floor(i - pred_pos)));
+      max_errors[leaf_idx] = std::max(
+          max_errors[leaf_idx], static_cast<long>(std::ceil(i - pred_pos)));
+    }
+  }
+
+  /**
+   * @brief Returns the first position in the indexed range whose key is not
+   * less than `key`, like std::lower_bound.
+   */
+  RandomIt lower_bound(const T &key) const {
+    if (!rmi.trained) return std::lower_bound(first, last, key);
+
+    const auto [window_start, window_end] = search_window(key);
+    return extend_search(
+        std::lower_bound(first + window_start, first + window_end, key),
+        window_start, window_end, key);
+  }
+
+  /**
+   * @brief Returns the range of positions in the indexed range whose keys are
+   * equal to `key`, like std::equal_range.
+   */
+  std::pair<RandomIt, RandomIt> equal_range(const T &key) const {
+    const auto lower = lower_bound(key);
+    if (lower == last || key < *lower) return {lower, lower};
+
+    // The copies of the key are usually few, so they are skipped with an
+    // exponential search from the first one
+    return {lower, learned_sort::utils::exponential_lower_bound(
+                       lower + 1, last, lower + 1, key,
+                       [](const T &a, const T &b) { return !(b < a); })};
+  }
+
+  /**
+   * @brief Finds the lower bounds of the keys in [probes_begin, probes_end),
+   * and writes their offsets from the beginning of the indexed range to the
+   * range beginning at out_positions.
+   *
+   * The probes are searched in groups of LOOKUP_GROUP_SZ, whose binary searches
+   * advance in lockstep, and prefetch the keys that they compare next. This
+   * overlaps the cache misses of the searches, instead of waiting for each of
+   * them in turn. When the probes are sorted, every search starts instead from
+   * the lower bound of the previous probe, with an exponential search that
+   * stays within the search window of the model.
+   */
+  template <class ProbeIt, class OutIt>
+  void lookup_batch(ProbeIt probes_begin, ProbeIt probes_end,
+                    OutIt out_positions) const {
+    if (std::is_sorted(probes_begin, probes_end)) {
+      // The lower bounds of sorted probes are sorted as well
+      auto prev_bound = first;
+      for (auto it = probes_begin; it != probes_end; ++it) {
+        auto start = prev_bound;
+        auto window_end = last;
+        if (rmi.trained) {
+          const auto window = search_window(*it);
+          start = std::max(start, first + window.first);
+          window_end = std::max(start, first + window.second);
+        }
+        auto bound = learned_sort::utils::exponential_lower_bound(
+            start, window_end, start, *it, std::less<>());
+        if (bound == start && start != prev_bound && !(start[-1] < *it)) {
+          bound = learned_sort::utils::exponential_lower_bound(
+              prev_bound, start, start, *it, std::less<>());
+        } else if (bound == window_end) {
+          bound = learned_sort::utils::exponential_lower_bound(
+              window_end, last, window_end, *it, std::less<>());
+        }
+        *out_positions++ = bound - first;
+        prev_bound = bound;
+      }
+      return;
+    }
+
+    if (!rmi.trained) {
+      for (auto it = probes_begin; it != probes_end; ++it) {
+        *out_positions++ = std::lower_bound(first, last, *it) - first;
+      }
+      return;
+    }
+
+    T keys[LOOKUP_GROUP_SZ];
+    long window_starts[LOOKUP_GROUP_SZ];
+    long window_ends[LOOKUP_GROUP_SZ];
+    long bases[LOOKUP_GROUP_SZ];
+    long lengths[LOOKUP_GROUP_SZ];
+    for (auto group_start = probes_begin; group_start != probes_end;) {
+      const long group_sz =
+          std::min<long>(LOOKUP_GROUP_SZ, probes_end - group_start);
+
+      // Predict the search windows of the group, and prefetch their middles
+      long max_length = 0;
+      for (long j = 0; j < group_sz; ++j) {
+        keys[j] = group_start[j];
+        std::tie(window_starts[j], window_ends[j]) = search_window(keys[j]);
+        bases[j] = window_starts[j];
+        lengths[j] = window_ends[j] - window_starts[j];
+        max_length = std::max(max_length, lengths[j]);
+        if (lengths[j] > 0) {
+          __builtin_prefetch(&first[bases[j] + lengths[j] / 2]);
+        }
+      }
+
+      // Halve all the windows in every round, until each holds a single key
+      while (max_length > 1) {
+        max_length = 0;
+        for (long j = 0; j < group_sz; ++j) {
+          if (lengths[j] <= 1) continue;
+          const long half = lengths[j] / 2;
+          bases[j] = first[bases[j] + half] < keys[j] ? bases[j] + half
+                                                       : bases[j];
+          lengths[j] -= half;
+          max_length = std::max(max_length, lengths[j]);
+          __builtin_prefetch(&first[bases[j] + lengths[j] / 2]);
+        }
+      }
+
+      for (long j = 0; j < group_sz; ++j) {
+        const long bound =
+            bases[j] + (lengths[j] == 1 && first[bases[j]] < keys[j]);
+        *out_positions++ = extend_search(first + bound, window_starts[j],
+                                         window_ends[j], keys[j]) -
+                           first;
+      }
+      group_start += group_sz;
+    }
+  }
+
+  // Returns the width of the widest search window, i.e., the maximum number
+  // of positions that a query for a key of the input searches
+  long max_search_window() const {
+    long max_window = 0;
+    for (size_t i = 0; i < min_errors.size(); ++i) {
+      max_window = std::max(max_window, max_errors[i] - min_errors[i] + 2);
+    }
+    return rmi.trained ? max_window : std::distance(first, last);
+  }
+
+  // Returns the indexed range
+  RandomIt begin() const { return first; }
+  RandomIt end() const { return last; }
+
+  // The number of probes whose searches are interleaved by lookup_batch()
+  static constexpr long LOOKUP_GROUP_SZ = 16;
+
+ private:
+  // Returns the window of offsets [start, end) in which `key` is, if it is in
+  // the input
+  std::pair<long, long> search_window(const T &key) const {
+    const long input_sz = std::distance(first, last);
+    const long leaf_idx = rmi.leaf_index(key);
+    const double pred_pos = rmi.predict(key) * input_sz;
+    long window_start = static_cast<long>(std::floor(pred_pos));
+    long window_end = window_start + 1;
+    if (min_errors[leaf_idx] <= max_errors[leaf_idx]) {
+      window_start = static_cast<long>(std::floor(pred_pos)) +
+                     min_errors[leaf_idx];
+      window_end = static_cast<long>(std::ceil(pred_pos)) +
+                   max_errors[leaf_idx] + 1;
+    }
+    window_start = std::max(0L, std::min(input_sz, window_start));
+    window_end = std::max(window_start, std::min(input_sz, window_end));
+    return {window_start, window_end};
+  }
+
+  // Returns the lower bound of `key`, given its lower bound `bound` within
+  // its search window. The search continues outside of the window only if the
+  // bound is not within it.
+  RandomIt extend_search(RandomIt bound, long window_start, long window_end,
+                         const T &key) const {
+    const auto lo = first + window_start;
+    const auto hi = first + window_end;
+    if (bound == lo && lo != first && !(lo[-1] < key)) {
+      return learned_sort::utils::exponential_lower_bound(first, lo, lo, key,
+                                                          std::less<>());
+    }
+    if (bound == hi && hi != last && *hi < key) {
+      return learned_sort::utils::exponential_lower_bound(hi, last, hi, key,
+                                                          std::less<>());
+    }
+    return bound;
+  }
+
+  // The CDF model of the keys
+  TwoLayerRMI<T> rmi;
+
+  // The error bounds of each leaf model, as offsets from the predicted
+  // positions
+  std::pmr::vector<long> min_errors;
+  std::pmr::vector<long> max_errors;
+
+  RandomIt first;
+  RandomIt last;
+};
+
+/**
+ * @brief Sorts the keys in [begin, end) in ascending order using Learned Sort
+ * (see sort()), and returns a LearnedIndex over them that reuses the CDF model
+ * that was trained for sorting, instead of training another one.
+ *
+ * @param resource The memory resource for the CDF model and the auxiliary
+ * buffers. Defaults to the one set with utils::set_scratch_resource().
+ */
+template <class RandomIt>
+LearnedIndex<RandomIt> sort_with_index(
+    RandomIt begin, RandomIt end,
+    std::pmr::memory_resource *resource =
+        learned_sort::utils::scratch_resource()) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+
+  typename TwoLayerRMI<T>::Params params;
+  TwoLayerRMI<T> rmi(params, resource);
+  if (begin != end) {
+    learned_sort::sort(begin, end, params, resource, &rmi);
+  }
+  return LearnedIndex<RandomIt>(begin, end, rmi);
+}
+
+}  // namespace learned_sort
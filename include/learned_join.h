@@ -0,0 +1,198 @@
+#pragma once
+
+/**
+ * @file learned_join.h
+ * @brief An equi-join of two sequences of numerical keys, which partitions both
+ * of them with a shared CDF model, instead of sorting them.
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo <anikristo@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <iterator>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "learned_sort.h"
+#include "rmi.h"
+#include "utils.h"
+
+namespace learned_sort {
+
+/**
+ * @brief Joins the keys in [left_begin, left_end) with the equal keys in
+ * [right_begin, right_end), and returns the pairs of their offsets in the two
+ * inputs, i.e., every (i, j) for which left_begin[i] == right_begin[j].
+ *
+ * A single CDF model is trained on a sample that is drawn from both inputs in
+ * proportion to their sizes, and both of them are partitioned into the same
+ * PRIMARY_FANOUT buckets with it. Since the model predicts the same bucket for
+ * equal keys, every match is between a pair of co-aligned buckets. Each pair
+ * is then joined on its own thread with a hash join, whose table fits in the
+ * cache, so neither input is sorted or modified.
+ *
+ * @param resource The memory resource for the CDF model and the auxiliary
+ * buffers, including the matches of each bucket, which are collected on
+ * multiple threads, so it must be thread-safe. Defaults to the one set with
+ * utils::set_scratch_resource(). Only the returned matches are allocated from
+ * the heap.
+ * @param num_threads The number of threads to partition and join on
+ * @return The pairs of offsets of the matching keys. The matches within each
+ * bucket are ordered by their left, then right offsets.
+ */
+template <class LeftIt, class RightIt>
+std::vector<std::pair<long, long>> join(
+    LeftIt left_begin, LeftIt left_end, RightIt right_begin, RightIt right_end,
+    std::pmr::memory_resource *resource =
+        learned_sort::utils::scratch_resource(),
+    long num_threads = learned_sort::utils::default_num_threads()) {
+  // Determine the data type
+  typedef typename std::iterator_traits<LeftIt>::value_type T;
+  static_assert(
+      std::is_same_v<T, typename std::iterator_traits<RightIt>::value_type>,
+      "Both inputs of a join must have the same key type");
+  typedef std::pair<T, long> entry_t;
+
+  const long left_sz = std::distance(left_begin, left_end);
+  const long right_sz = std::distance(right_begin, right_end);
+  const long input_sz = left_sz + right_sz;
+  std::vector<std::pair<long, long>> matches;
+  if (left_sz == 0 || right_sz == 0) return matches;
+
+  // Train the CDF model on a sample that is drawn from both inputs in
+  // proportion to their sizes
+  typename TwoLayerRMI<T>::Params params;
+  TwoLayerRMI<T> rmi(params, resource);
+  long num_buckets = 1;
+  if (input_sz > std::max<long>(params.fanout * params.threshold,
+                                5 * params.num_leaf_models)) {
+    // The sample must be large enough for the threshold to be valid on it
+    const long sample_sz = std::min<long>(
+        input_sz, std::max<long>(params.sampling_rate * input_sz,
+                                 2 * params.fanout * params.threshold));
+    std::pmr::vector<T> sample(resource);
+    sample.reserve(sample_sz + 2);
+    auto draw_sample = [&](auto begin, long sz) {
+      const long side_sample_sz = (sz * sample_sz + input_sz - 1) / input_sz;
+      for (long i = 0; i < side_sample_sz; ++i) {
+        sample.push_back(begin[i * sz / side_sample_sz]);
+      }
+    };
+    draw_sample(left_begin, left_sz);
+    draw_sample(right_begin, right_sz);
+    std::sort(sample.begin(), sample.end());
+
+    // The model is trained on the whole sample
+    rmi.hp.sampling_rate = 1;
+    if (rmi.train(sample.begin(), sample.end())) num_buckets = PRIMARY_FANOUT;
+  }
+  auto bucket_of = [&](const T &key) {
+    if (num_buckets == 1) return 0L;
+    return static_cast<long>(std::max(
+        0., std::min(num_buckets - 1., rmi.predict(key) * num_buckets)));
+  };
+
+  // Partition both inputs into co-aligned buckets
+  learned_sort::utils::scratch_buffer<entry_t> left_entries(left_sz, resource);
+  learned_sort::utils::scratch_buffer<entry_t> right_entries(right_sz,
+                                                             resource);
+  std::pmr::vector<long> left_offsets(resource);
+  std::pmr::vector<long> right_offsets(resource);
+  learned_sort::utils::partition_by_bucket(
+      left_begin, left_end, bucket_of, num_buckets, left_entries.data(),
+      left_offsets, num_threads, resource);
+  learned_sort::utils::partition_by_bucket(
+      right_begin, right_end, bucket_of, num_buckets, right_entries.data(),
+      right_offsets, num_threads, resource);
+
+  // Reserve a hash table with a power-of-two number of slots for the right
+  // side of every pair of buckets
+  std::pmr::vector<long> table_offsets(num_buckets + 1, 0, resource);
+  for (long bucket_idx = 0; bucket_idx < num_buckets; ++bucket_idx) {
+    const unsigned long right_bucket_sz =
+        right_offsets[bucket_idx + 1] - right_offsets[bucket_idx];
+    table_offsets[bucket_idx + 1] =
+        table_offsets[bucket_idx] + std::bit_ceil(right_bucket_sz);
+  }
+  std::pmr::vector<long> heads(table_offsets[num_buckets], resource);
+  std::pmr::vector<long> next(right_sz, resource);
+
+  // Join every pair of buckets with a hash join, which chains the right
+  // entries of each slot in order of their offsets, and probes the table with
+  // the left entries in order of theirs
+  std::pmr::vector<std::pmr::vector<std::pair<long, long>>> bucket_matches(
+      num_buckets, resource);
+  learned_sort::utils::parallel_for(
+      num_buckets, num_threads, [&](long bucket_idx) {
+        const long left_start = left_offsets[bucket_idx];
+        const long left_end = left_offsets[bucket_idx + 1];
+        const long right_start = right_offsets[bucket_idx];
+        const long right_end = right_offsets[bucket_idx + 1];
+        if (left_start == left_end || right_start == right_end) return;
+
+        // Find the slot of a key by Fibonacci hashing
+        long *table = heads.data() + table_offsets[bucket_idx];
+        const long num_slots =
+            table_offsets[bucket_idx + 1] - table_offsets[bucket_idx];
+        const int hash_shift = 64 - std::countr_zero<unsigned long>(num_slots);
+        auto slot_of = [&](const T &key) -> long {
+          if (hash_shift == 64) return 0;
+          return (std::hash<T>()(key) * 0x9E3779B97F4A7C15ul) >> hash_shift;
+        };
+
+        // Build the table
+        std::fill_n(table, num_slots, -1L);
+        for (long k = right_end - 1; k >= right_start; --k) {
+          long &head = table[slot_of(right_entries.data()[k].first)];
+          next[k] = head;
+          head = k;
+        }
+
+        // Probe it
+        auto &out = bucket_matches[bucket_idx];
+        for (long i = left_start; i < left_end; ++i) {
+          const auto &[key, left_off] = left_entries.data()[i];
+          for (long k = table[slot_of(key)]; k != -1; k = next[k]) {
+            if (right_entries.data()[k].first == key) {
+              out.emplace_back(left_off, right_entries.data()[k].second);
+            }
+          }
+        }
+      });
+
+  // Concatenate the matches of the buckets
+  std::pmr::vector<long> match_offsets(num_buckets + 1, 0, resource);
+  for (long bucket_idx = 0; bucket_idx < num_buckets; ++bucket_idx) {
+    match_offsets[bucket_idx + 1] =
+        match_offsets[bucket_idx] + bucket_matches[bucket_idx].size();
+  }
+  matches.resize(match_offsets[num_buckets]);
+  learned_sort::utils::parallel_for(
+      num_buckets, num_threads, [&](long bucket_idx) {
+        std::copy(bucket_matches[bucket_idx].begin(),
+                  bucket_matches[bucket_idx].end(),
+                  matches.begin() + match_offsets[bucket_idx]);
+        bucket_matches[bucket_idx].clear();
+        bucket_matches[bucket_idx].shrink_to_fit();
+      });
+
+  return matches;
+}
+
+}  // namespace learned_sort
@@ -24,7 +24,13 @@
 
 #include <algorithm>
 #include <cmath>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <memory_resource>
+#include <ranges>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "rmi.h"
@@ -42,9 +48,88 @@ static constexpr int PRIMARY_FRAGMENT_CAPACITY = 100;
 static constexpr int SECONDARY_FRAGMENT_CAPACITY = 100;
 static constexpr int REP_CNT_THRESHOLD = 5;
 
-template <class RandomIt>
-void sort(RandomIt begin, RandomIt end,
-          TwoLayerRMI<typename iterator_traits<RandomIt>::value_type> &rmi) {
+// How many keys ahead to prefetch the leaf models for during the partitioning,
+// when the model table is too large to stay in the L1 cache
+static constexpr int LEAF_PREFETCH_DISTANCE = 8;
+static constexpr long LEAF_PREFETCH_MIN_TABLE_SZ = 32 * 1024;
+
+// The number of keys whose buckets are predicted before they are scattered
+static constexpr int PREDICTION_BATCH_SZ = 16;
+
+// The maximum number of positions by which single-precision inference may
+// displace a key w.r.t. double-precision inference for it to be used instead
+static constexpr double MAX_FLOAT_INFERENCE_DISPLACEMENT = 1;
+
+// The number of evenly spaced pairs of adjacent keys that are sampled to
+// estimate the presortedness of the input
+static constexpr long PRESORTEDNESS_SAMPLE_SZ = 1024;
+
+// The maximum fraction of the sampled pairs that may be out of order for the
+// input to be searched for sorted runs
+static constexpr double MAX_SAMPLED_DESCENT_RATIO = 1. / 32;
+
+// The maximum number of sorted runs that are merged instead of sorting the
+// input, since each doubling of the runs costs another pass over the keys
+static constexpr long MAX_MERGED_RUNS = 16;
+
+// The minimum number of keys in each of the segments that are merged in
+// parallel
+static constexpr long MIN_MERGE_SEGMENT_SZ = 1 << 16;
+
+// The direction in which the keys are sorted
+enum class order { ascending, descending };
+
+// The comparator that orders the keys in the given direction
+template <order Order>
+using order_comparator = std::conditional_t<Order == order::ascending,
+                                            std::less<>, std::greater<>>;
+
+/**
+ * @brief The progress of a sort with a trained CDF model, which is carried over
+ * between the calls to sort_step().
+ */
+template <class P>
+struct sort_state {
+  explicit sort_state(std::pmr::memory_resource *resource)
+      : descending_leaf_models(resource) {}
+
+  // Whether the keys were partitioned into the primary buckets
+  bool partitioned = false;
+
+  // The index of the next primary bucket to be sorted
+  long next_bucket = 0;
+
+  // Keeps track of the number of elements in each bucket
+  long primary_bucket_sizes[PRIMARY_FANOUT]{0};
+
+  // Counts the number of elements that are done going through the
+  // partitioning steps for good
+  long num_elms_finalized = 0;
+
+  // Counts the number of distinct keys that were compacted at the beginning of
+  // the input, when duplicates are removed
+  long num_unique_elms = 0;
+
+  // The leaf models with the inverted CDF, for descending sorts
+  std::pmr::vector<linear_model<P>> descending_leaf_models;
+};
+
+/**
+ * @brief Runs a step of sorting [begin, end) with a trained CDF model, in the
+ * given order. The first step partitions the keys into the primary buckets,
+ * and every step then sorts the primary buckets from `state.next_bucket` up to
+ * `last_bucket`. The step that reaches PRIMARY_FANOUT finishes the sort.
+ *
+ * Between the steps, [begin, end) holds all of its keys, unless `Unique` is
+ * set, and neither `state` nor `rmi` may be changed.
+ *
+ * @return The end of the sorted keys after the last step, and `end` otherwise
+ */
+template <order Order, bool Unique, class RandomIt, class P>
+RandomIt sort_step(
+    RandomIt begin, RandomIt end,
+    TwoLayerRMI<typename iterator_traits<RandomIt>::value_type, P> &rmi,
+    sort_state<P> &state, long last_bucket) {
   //----------------------------------------------------------//
   //                          INIT                            //
   //----------------------------------------------------------//
@@ -54,37 +139,55 @@ void sort(RandomIt begin, RandomIt end,
 
   // Constants
   const long input_sz = std::distance(begin, end);
-  const long TRAINING_SAMPLE_SZ = rmi.training_sample.size();
 
-  // Keeps track of the number of elements in each bucket
-  long primary_bucket_sizes[PRIMARY_FANOUT]{0};
+  // The progress of the sort
+  long *primary_bucket_sizes = state.primary_bucket_sizes;
+  long &num_elms_finalized = state.num_elms_finalized;
+  long &num_unique_elms = state.num_unique_elms;
 
-  // Counts the number of elements that are done going through the
-  // partitioning steps for good
-  long num_elms_finalized = 0;
+  const order_comparator<Order> comp;
 
   // Cache the model parameters
   const long num_leaf_models = rmi.hp.num_leaf_models;
-  double root_slope = rmi.root_model.slope;
-  double root_intercept = rmi.root_model.intercept;
-  auto num_models = rmi.hp.num_leaf_models;
-  double slopes[num_leaf_models];
-  double intercepts[num_leaf_models];
-  for (auto i = 0; i < num_leaf_models; ++i) {
-    slopes[i] = rmi.leaf_models[i].slope;
-    intercepts[i] = rmi.leaf_models[i].intercept;
+  P root_slope = rmi.root_model.slope;
+  P root_intercept = rmi.root_model.intercept;
+  const linear_model<P> *leaf_models = rmi.leaf_models.data();
+  const bool prefetch_leaf_models =
+      num_leaf_models * sizeof(linear_model<P>) > LEAF_PREFETCH_MIN_TABLE_SZ;
+
+  // The memory resource for the auxiliary buffers
+  std::pmr::memory_resource *scratch = rmi.resource;
+
+  // Descending sorts place the keys by 1 - F(x), so that the largest keys land
+  // in the first buckets. The inversion is folded into a copy of the leaf
+  // models, so every partitioning step predicts it at no extra cost per key.
+  std::pmr::vector<linear_model<P>> &descending_leaf_models =
+      state.descending_leaf_models;
+  if constexpr (Order == order::descending) {
+    if (descending_leaf_models.empty()) {
+      descending_leaf_models.reserve(num_leaf_models);
+      for (const auto &leaf : rmi.leaf_models) {
+        descending_leaf_models.push_back({-leaf.slope, 1 - leaf.intercept});
+      }
+    }
+    leaf_models = descending_leaf_models.data();
   }
 
   //----------------------------------------------------------//
   //              PARTITION THE KEYS INTO BUCKETS             //
   //----------------------------------------------------------//
 
-  {
+  if (!state.partitioned) {
+    state.partitioned = true;
+
     // Keeps track of the number of elements in each fragment
     long fragment_sizes[PRIMARY_FANOUT]{0};
 
     // An auxiliary set of fragments where the elements will be partitioned
-    auto fragments = new T[PRIMARY_FANOUT][PRIMARY_FRAGMENT_CAPACITY];
+    learned_sort::utils::scratch_buffer<T> fragment_buf(
+        PRIMARY_FANOUT * PRIMARY_FRAGMENT_CAPACITY, scratch);
+    auto fragments =
+        reinterpret_cast<T(*)[PRIMARY_FRAGMENT_CAPACITY]>(fragment_buf.data());
 
     // Keeps track of the number of fragments that have been written back to the
     // original array
@@ -93,43 +196,83 @@ void sort(RandomIt begin, RandomIt end,
     // Points to the next free space where to write back
     auto write_itr = begin;
 
-    // For each element in the input, predict which bucket it would go to, and
-    // insert to the respective bucket fragment
-    for (auto it = begin; it != end; ++it) {
-      // Predict the model id in the leaf layer of the RMI
-      long pred_bucket_idx = static_cast<long>(std::max(
-          0.,
-          std::min(num_leaf_models - 1., root_slope * it[0] + root_intercept)));
+    // Caches the predicted buckets for a batch of keys
+    long pred_bucket_batch[PREDICTION_BATCH_SZ];
+
+    // Process the input in batches, first predicting the buckets for all the
+    // keys in the batch, and then inserting them to the respective fragments
+    for (long batch_off = 0; batch_off < input_sz;
+         batch_off += PREDICTION_BATCH_SZ) {
+      const auto batch_start = begin + batch_off;
+      const long batch_sz =
+          std::min<long>(PREDICTION_BATCH_SZ, input_sz - batch_off);
+
+      for (long elm_idx = 0; elm_idx < batch_sz; ++elm_idx) {
+        // Prefetch the leaf model of an upcoming key
+        if (prefetch_leaf_models &&
+            batch_off + elm_idx + LEAF_PREFETCH_DISTANCE < input_sz) {
+          __builtin_prefetch(
+              leaf_models +
+              static_cast<long>(std::max<P>(
+                  0, std::min<P>(
+                         num_leaf_models - 1,
+                         root_slope * batch_start[elm_idx +
+                                                  LEAF_PREFETCH_DISTANCE] +
+                             root_intercept))));
+        }
 
-      // Predict the CDF
-      double pred_cdf =
-          slopes[pred_bucket_idx] * it[0] + intercepts[pred_bucket_idx];
+        const auto key = batch_start[elm_idx];
 
-      // Get the predicted bucket id
-      pred_bucket_idx = static_cast<long>(std::max(
-          0., std::min(PRIMARY_FANOUT - 1., pred_cdf * PRIMARY_FANOUT)));
-
-      // Place the current element in the predicted fragment
-      fragments[pred_bucket_idx][fragment_sizes[pred_bucket_idx]] = it[0];
-
-      // Update the fragment size and the bucket size
-      primary_bucket_sizes[pred_bucket_idx]++;
-      fragment_sizes[pred_bucket_idx]++;
-
-      if (fragment_sizes[pred_bucket_idx] == PRIMARY_FRAGMENT_CAPACITY) {
-        fragments_written++;
-        // The predicted fragment is full, place in the array and update bucket
-        // size
-        std::move(fragments[pred_bucket_idx],
-                  fragments[pred_bucket_idx] + PRIMARY_FRAGMENT_CAPACITY,
-                  write_itr);
-        write_itr += PRIMARY_FRAGMENT_CAPACITY;
-
-        // Reset the fragment size
-        fragment_sizes[pred_bucket_idx] = 0;
+        // Predict the model id in the leaf layer of the RMI
+        long pred_bucket_idx = static_cast<long>(std::max<P>(
+            0, std::min<P>(num_leaf_models - 1,
+                           root_slope * key + root_intercept)));
+
+        // Predict the CDF
+        const auto &leaf = leaf_models[pred_bucket_idx];
+        P pred_cdf = leaf.slope * key + leaf.intercept;
+
+        // Get the predicted bucket id
+        pred_bucket_idx = static_cast<long>(std::max<P>(
+            0, std::min<P>(PRIMARY_FANOUT - 1, pred_cdf * PRIMARY_FANOUT)));
+        pred_bucket_batch[elm_idx] = pred_bucket_idx;
+
+        // Prefetch the slot in the fragment where the key will be placed
+        __builtin_prefetch(
+            &fragments[pred_bucket_idx][fragment_sizes[pred_bucket_idx]], 1);
+      }
+
+      for (long elm_idx = 0; elm_idx < batch_sz; ++elm_idx) {
+        const long pred_bucket_idx = pred_bucket_batch[elm_idx];
+
+        // Place the current element in the predicted fragment
+        fragments[pred_bucket_idx][fragment_sizes[pred_bucket_idx]] =
+            batch_start[elm_idx];
+
+        // Update the fragment size and the bucket size
+        primary_bucket_sizes[pred_bucket_idx]++;
+        fragment_sizes[pred_bucket_idx]++;
+
+        if (fragment_sizes[pred_bucket_idx] == PRIMARY_FRAGMENT_CAPACITY) {
+          fragments_written++;
+          // The predicted fragment is full, place in the array and update
+          // bucket size. The array will not be read again until the
+          // defragmentation, so bypass the cache when writing to it.
+          learned_sort::utils::stream_copy(
+              fragments[pred_bucket_idx],
+              fragments[pred_bucket_idx] + PRIMARY_FRAGMENT_CAPACITY,
+              write_itr);
+          write_itr += PRIMARY_FRAGMENT_CAPACITY;
+
+          // Reset the fragment size
+          fragment_sizes[pred_bucket_idx] = 0;
+        }
       }
     }
 
+    // Make the streamed fragments visible before they are read back
+    learned_sort::utils::stream_fence();
+
     //----------------------------------------------------------//
     //                     DEFRAGMENTATION                      //
     //----------------------------------------------------------//
@@ -139,7 +282,9 @@ void sort(RandomIt begin, RandomIt end,
     bucket_end_offset[0] = primary_bucket_sizes[0];
 
     // Swap space
-    T *swap_buffer = new T[PRIMARY_FRAGMENT_CAPACITY];
+    learned_sort::utils::scratch_buffer<T> swap_buf(PRIMARY_FRAGMENT_CAPACITY,
+                                                    scratch);
+    T *swap_buffer = swap_buf.data();
 
     // Maintains a writing iterator for each bucket, initialized at the starting
     // offsets
@@ -192,18 +337,17 @@ void sort(RandomIt begin, RandomIt end,
       // Find out what bucket the current fragment belongs to by looking at RMI
       // prediction for the first element of the fragment.
       auto first_elm_in_fragment = begin[cur_fragment_start_off];
-      long pred_bucket_for_cur_fragment = static_cast<long>(std::max(
-          0., std::min(num_leaf_models - 1.,
-                       root_slope * first_elm_in_fragment + root_intercept)));
+      long pred_bucket_for_cur_fragment = static_cast<long>(std::max<P>(
+          0, std::min<P>(num_leaf_models - 1,
+                         root_slope * first_elm_in_fragment + root_intercept)));
 
       // Predict the CDF
-      double pred_cdf =
-          slopes[pred_bucket_for_cur_fragment] * first_elm_in_fragment +
-          intercepts[pred_bucket_for_cur_fragment];
+      const auto &leaf = leaf_models[pred_bucket_for_cur_fragment];
+      P pred_cdf = leaf.slope * first_elm_in_fragment + leaf.intercept;
 
       // Get the predicted bucket id
-      pred_bucket_for_cur_fragment = static_cast<long>(std::max(
-          0., std::min(PRIMARY_FANOUT - 1., pred_cdf * PRIMARY_FANOUT)));
+      pred_bucket_for_cur_fragment = static_cast<long>(std::max<P>(
+          0, std::min<P>(PRIMARY_FANOUT - 1, pred_cdf * PRIMARY_FANOUT)));
 
       // If the current bucket contains fragments that are not all the way full,
       // no need to use a swap buffer, since there is available space. The first
@@ -330,22 +474,23 @@ void sort(RandomIt begin, RandomIt end,
               begin[bucket_write_off[pred_bucket_for_cur_fragment]];
 
           long pred_bucket_for_fragment_to_be_swapped_out =
-              static_cast<long>(std::max(
-                  0., std::min(
-                          num_leaf_models - 1.,
-                          root_slope * first_elm_in_fragment_to_be_swapped_out +
-                              root_intercept)));
+              static_cast<long>(std::max<P>(
+                  0, std::min<P>(
+                         num_leaf_models - 1,
+                         root_slope * first_elm_in_fragment_to_be_swapped_out +
+                             root_intercept)));
 
           // Predict the CDF
-          double pred_cdf =
-              slopes[pred_bucket_for_fragment_to_be_swapped_out] *
-                  first_elm_in_fragment_to_be_swapped_out +
-              intercepts[pred_bucket_for_fragment_to_be_swapped_out];
+          const auto &leaf =
+              leaf_models[pred_bucket_for_fragment_to_be_swapped_out];
+          P pred_cdf =
+              leaf.slope * first_elm_in_fragment_to_be_swapped_out +
+              leaf.intercept;
 
           // Get the predicted bucket idx
           pred_bucket_for_fragment_to_be_swapped_out = static_cast<long>(
-              std::max(0., std::min(PRIMARY_FANOUT - 1.,
-                                    pred_cdf * PRIMARY_FANOUT)));
+              std::max<P>(0, std::min<P>(PRIMARY_FANOUT - 1,
+                                         pred_cdf * PRIMARY_FANOUT)));
 
           // If the fragment at the next write offset is not already in the
           // right bucket, swap the fragments
@@ -385,10 +530,7 @@ void sort(RandomIt begin, RandomIt end,
     // flushed to the input array
     for (long bucket_idx = 0; bucket_idx < PRIMARY_FANOUT; ++bucket_idx) {
       // Set the writing offset to the beggining of the bucket
-      long write_off = bucket_end_offset[bucket_idx - 1];
-      if (bucket_idx == 0) {
-        write_off = 0;
-      }
+      long write_off = bucket_idx == 0 ? 0 : bucket_end_offset[bucket_idx - 1];
 
       // Add the elements left in the auxiliary fragments to the beggining of
       // the predicted bucket, since it was not full
@@ -408,22 +550,37 @@ void sort(RandomIt begin, RandomIt end,
       }
     }
 
-    // Cleanup
-    delete[] swap_buffer;
-    delete[] fragments;
+    // Record the bucket fill in the model, in ascending order of the CDF
+    rmi.bucket_fill.assign(primary_bucket_sizes,
+                           primary_bucket_sizes + PRIMARY_FANOUT);
+    if constexpr (Order == order::descending) {
+      std::reverse(rmi.bucket_fill.begin(), rmi.bucket_fill.end());
+    }
   }
 
   //----------------------------------------------------------//
   //                SECOND ROUND OF PARTITIONING              //
   //----------------------------------------------------------//
 
-  {
+  if (state.next_bucket < last_bucket) {
+    // An auxiliary set of fragments where the elements will be partitioned,
+    // which is reused for every primary bucket
+    learned_sort::utils::scratch_buffer<T> fragment_buf(
+        SECONDARY_FANOUT * SECONDARY_FRAGMENT_CAPACITY, scratch);
+    auto fragments = reinterpret_cast<T(*)[SECONDARY_FRAGMENT_CAPACITY]>(
+        fragment_buf.data());
+
+    // Swap space
+    learned_sort::utils::scratch_buffer<T> swap_buf(SECONDARY_FRAGMENT_CAPACITY,
+                                                    scratch);
+    T *swap_buffer = swap_buf.data();
+
     // Iterate over each bucket starting from the end so that the merging step
     // later is done in-place
-    auto primary_bucket_start = begin;
-    auto primary_bucket_end = begin;
-    for (long primary_bucket_idx = 0; primary_bucket_idx < PRIMARY_FANOUT;
-         ++primary_bucket_idx) {
+    auto primary_bucket_start = begin + num_elms_finalized;
+    auto primary_bucket_end = begin + num_elms_finalized;
+    for (long primary_bucket_idx = state.next_bucket;
+         primary_bucket_idx < last_bucket; ++primary_bucket_idx) {
       auto primary_bucket_sz = primary_bucket_sizes[primary_bucket_idx];
 
       // Skip bucket if empty
@@ -447,6 +604,9 @@ void sort(RandomIt begin, RandomIt end,
 
       // When the bucket is homogeneous, skip sorting it
       if (rmi.enable_dups_detection && is_homogeneous) {
+        if constexpr (Unique) {
+          begin[num_unique_elms++] = primary_bucket_start[0];
+        }
         num_elms_finalized += primary_bucket_sz;
 
       }
@@ -463,9 +623,6 @@ void sort(RandomIt begin, RandomIt end,
         // Keeps track of the number of elements in each fragment
         long fragment_sizes[SECONDARY_FANOUT]{0};
 
-        // An auxiliary set of fragments where the elements will be partitioned
-        auto fragments = new T[SECONDARY_FANOUT][SECONDARY_FRAGMENT_CAPACITY];
-
         // Keeps track of the number of fragments that have been written back to
         // the original array
         long fragments_written = 0;
@@ -478,18 +635,18 @@ void sort(RandomIt begin, RandomIt end,
         for (auto it = primary_bucket_start; it != primary_bucket_end; ++it) {
           // Predict the model id in the leaf layer of the RMI
           long pred_bucket_idx = static_cast<long>(
-              std::max(0., std::min(num_leaf_models - 1.,
-                                    root_slope * it[0] + root_intercept)));
+              std::max<P>(0, std::min<P>(num_leaf_models - 1,
+                                         root_slope * it[0] + root_intercept)));
 
           // Predict the CDF
-          double pred_cdf =
-              slopes[pred_bucket_idx] * it[0] + intercepts[pred_bucket_idx];
+          const auto &leaf = leaf_models[pred_bucket_idx];
+          P pred_cdf = leaf.slope * it[0] + leaf.intercept;
 
           // Get the predicted bucket id
-          pred_bucket_idx = static_cast<long>(std::max(
-              0., std::min(SECONDARY_FANOUT - 1.,
-                           (pred_cdf * PRIMARY_FANOUT - primary_bucket_idx) *
-                               SECONDARY_FANOUT)));
+          pred_bucket_idx = static_cast<long>(std::max<P>(
+              0, std::min<P>(SECONDARY_FANOUT - 1,
+                             (pred_cdf * PRIMARY_FANOUT - primary_bucket_idx) *
+                                 SECONDARY_FANOUT)));
 
           // Place the current element in the predicted fragment
           fragments[pred_bucket_idx][fragment_sizes[pred_bucket_idx]] = it[0];
@@ -520,9 +677,6 @@ void sort(RandomIt begin, RandomIt end,
         long bucket_end_offset[SECONDARY_FANOUT]{0};
         bucket_end_offset[0] = secondary_bucket_sizes[0];
 
-        // Swap space
-        T *swap_buffer = new T[SECONDARY_FRAGMENT_CAPACITY];
-
         // Maintains a writing iterator for each bucket, initialized at the
         // starting offsets
         long bucket_start_off[SECONDARY_FANOUT]{0};
@@ -578,21 +732,20 @@ void sort(RandomIt begin, RandomIt end,
           // RMI prediction for the first element of the fragment.
           auto first_elm_in_fragment =
               primary_bucket_start[cur_fragment_start_off];
-          long pred_bucket_for_cur_fragment = static_cast<long>(std::max(
-              0.,
-              std::min(num_leaf_models - 1.,
-                       root_slope * first_elm_in_fragment + root_intercept)));
+          long pred_bucket_for_cur_fragment = static_cast<long>(std::max<P>(
+              0, std::min<P>(num_leaf_models - 1,
+                             root_slope * first_elm_in_fragment +
+                                 root_intercept)));
 
           // Predict the CDF
-          double pred_cdf =
-              slopes[pred_bucket_for_cur_fragment] * first_elm_in_fragment +
-              intercepts[pred_bucket_for_cur_fragment];
+          const auto &leaf = leaf_models[pred_bucket_for_cur_fragment];
+          P pred_cdf = leaf.slope * first_elm_in_fragment + leaf.intercept;
 
           // Get the predicted bucket id
-          pred_bucket_for_cur_fragment = static_cast<long>(std::max(
-              0., std::min(SECONDARY_FANOUT - 1.,
-                           (pred_cdf * PRIMARY_FANOUT - primary_bucket_idx) *
-                               SECONDARY_FANOUT)));
+          pred_bucket_for_cur_fragment = static_cast<long>(std::max<P>(
+              0, std::min<P>(SECONDARY_FANOUT - 1,
+                             (pred_cdf * PRIMARY_FANOUT - primary_bucket_idx) *
+                                 SECONDARY_FANOUT)));
 
           // If the current bucket contains fragments that are not all the way
           // full, no need to use a swap fragment, since there is available
@@ -730,25 +883,26 @@ void sort(RandomIt begin, RandomIt end,
                       [bucket_start_off[pred_bucket_for_cur_fragment]];
 
               long pred_bucket_for_fragment_to_be_swapped_out =
-                  static_cast<long>(std::max(
-                      0.,
-                      std::min(
-                          num_leaf_models - 1.,
+                  static_cast<long>(std::max<P>(
+                      0,
+                      std::min<P>(
+                          num_leaf_models - 1,
                           root_slope * first_elm_in_fragment_to_be_swapped_out +
                               root_intercept)));
 
               // Predict the CDF
-              double pred_cdf =
-                  slopes[pred_bucket_for_fragment_to_be_swapped_out] *
-                      first_elm_in_fragment_to_be_swapped_out +
-                  intercepts[pred_bucket_for_fragment_to_be_swapped_out];
+              const auto &leaf =
+                  leaf_models[pred_bucket_for_fragment_to_be_swapped_out];
+              P pred_cdf =
+                  leaf.slope * first_elm_in_fragment_to_be_swapped_out +
+                  leaf.intercept;
 
               // Get the predicted bucket idx
               pred_bucket_for_fragment_to_be_swapped_out = static_cast<long>(
-                  std::max(0., std::min(SECONDARY_FANOUT - 1.,
-                                        (pred_cdf * PRIMARY_FANOUT -
-                                         primary_bucket_idx) *
-                                            SECONDARY_FANOUT)));
+                  std::max<P>(0, std::min<P>(SECONDARY_FANOUT - 1,
+                                             (pred_cdf * PRIMARY_FANOUT -
+                                              primary_bucket_idx) *
+                                                 SECONDARY_FANOUT)));
 
               // If the fragment at the next write offset is not already in the
               // right bucket, swap the fragments
@@ -789,10 +943,8 @@ void sort(RandomIt begin, RandomIt end,
         // not flushed to the input array
         for (long bucket_idx = 0; bucket_idx < SECONDARY_FANOUT; ++bucket_idx) {
           // Set the writing offset to the beggining of the bucket
-          long write_off = bucket_end_offset[bucket_idx - 1];
-          if (bucket_idx == 0) {
-            write_off = 0;
-          }
+          long write_off =
+              bucket_idx == 0 ? 0 : bucket_end_offset[bucket_idx - 1];
 
           // Add the elements left in the auxiliary fragments to the beggining
           // of the predicted bucket, since it was not full
@@ -814,10 +966,6 @@ void sort(RandomIt begin, RandomIt end,
           }
         }
 
-        // Cleanup
-        delete[] swap_buffer;
-        delete[] fragments;
-
         //- - - - - - - - - - - - - - - - - - - - - - - - - - - -  -//
         //                MODEL-BASED COUNTING SORT                 //
         //- - - - - - - - - - - - - - - - - - - - - - - - - - - -  -//
@@ -852,10 +1000,10 @@ void sort(RandomIt begin, RandomIt end,
                 input_sz / (PRIMARY_FANOUT * SECONDARY_FANOUT);
 
             // Saves the predicted CDFs for the Counting Sort subroutine
-            vector<long> pred_cache_cs(secondary_bucket_sz);
+            std::pmr::vector<long> pred_cache_cs(secondary_bucket_sz, scratch);
 
             // Count array for the model-enhanced counting sort subroutine
-            vector<long> cnt_hist(secondary_bucket_sz, 0);
+            std::pmr::vector<long> cnt_hist(secondary_bucket_sz, 0, scratch);
 
             /*
              * OPTIMIZATION
@@ -866,15 +1014,16 @@ void sort(RandomIt begin, RandomIt end,
              * complexity from O(num_layer) to O(1).
              */
 
-            long pred_model_first_elm = static_cast<long>(std::max(
-                0., std::min(num_leaf_models - 1.,
-                             root_slope * begin[secondary_bucket_start_off] +
-                                 root_intercept)));
+            long pred_model_first_elm = static_cast<long>(std::max<P>(
+                0, std::min<P>(num_leaf_models - 1,
+                               root_slope * begin[secondary_bucket_start_off] +
+                                   root_intercept)));
 
-            long pred_model_last_elm = static_cast<long>(std::max(
-                0., std::min(num_leaf_models - 1.,
-                             root_slope * begin[secondary_bucket_end_off - 1] +
-                                 root_intercept)));
+            long pred_model_last_elm = static_cast<long>(std::max<P>(
+                0,
+                std::min<P>(num_leaf_models - 1,
+                            root_slope * begin[secondary_bucket_end_off - 1] +
+                                root_intercept)));
 
             if (pred_model_first_elm == pred_model_last_elm) {
               // Avoid CDF model traversal and predict the CDF only using the
@@ -887,13 +1036,13 @@ void sort(RandomIt begin, RandomIt end,
                 auto cur_key = begin[secondary_bucket_start_off + elm_idx];
 
                 // Predict the CDF
-                double pred_cdf = slopes[pred_model_first_elm] * cur_key +
-                                  intercepts[pred_model_first_elm];
+                const auto &leaf = leaf_models[pred_model_first_elm];
+                P pred_cdf = leaf.slope * cur_key + leaf.intercept;
 
                 // Scale the predicted CDF to the input size and save it
-                pred_cache_cs[elm_idx] = static_cast<long>(std::max(
-                    0., std::min(secondary_bucket_sz - 1.,
-                                 (pred_cdf * input_sz) - adjustment_offset)));
+                pred_cache_cs[elm_idx] = static_cast<long>(std::max<P>(
+                    0, std::min<P>(secondary_bucket_sz - 1,
+                                   (pred_cdf * input_sz) - adjustment_offset)));
 
                 // Update the counts
                 ++cnt_hist[pred_cache_cs[elm_idx]];
@@ -909,17 +1058,17 @@ void sort(RandomIt begin, RandomIt end,
                 auto cur_key = begin[secondary_bucket_start_off + elm_idx];
 
                 // Predict the model idx in the leaf layer
-                auto model_idx_next_layer = static_cast<long>(std::max(
-                    0., std::min(num_leaf_models - 1.,
-                                 root_slope * cur_key + root_intercept)));
+                auto model_idx_next_layer = static_cast<long>(std::max<P>(
+                    0, std::min<P>(num_leaf_models - 1,
+                                   root_slope * cur_key + root_intercept)));
                 // Predict the CDF
-                double pred_cdf = slopes[model_idx_next_layer] * cur_key +
-                                  intercepts[model_idx_next_layer];
+                const auto &leaf = leaf_models[model_idx_next_layer];
+                P pred_cdf = leaf.slope * cur_key + leaf.intercept;
 
                 // Scale the predicted CDF to the input size and save it
-                pred_cache_cs[elm_idx] = static_cast<long>(std::max(
-                    0., std::min(secondary_bucket_sz - 1.,
-                                 (pred_cdf * input_sz) - adjustment_offset)));
+                pred_cache_cs[elm_idx] = static_cast<long>(std::max<P>(
+                    0, std::min<P>(secondary_bucket_sz - 1,
+                                   (pred_cdf * input_sz) - adjustment_offset)));
 
                 // Update the counts
                 ++cnt_hist[pred_cache_cs[elm_idx]];
@@ -935,7 +1084,7 @@ void sort(RandomIt begin, RandomIt end,
 
             // Allocate a temporary buffer for placing the keys in sorted
             // order
-            vector<T> tmp(secondary_bucket_sz);
+            std::pmr::vector<T> tmp(secondary_bucket_sz, scratch);
 
             // Re-shuffle the elms based on the calculated cumulative counts
             for (long elm_idx = 0; elm_idx < secondary_bucket_sz; ++elm_idx) {
@@ -948,9 +1097,21 @@ void sort(RandomIt begin, RandomIt end,
               --cnt_hist[pred_cache_cs[elm_idx]];
             }
 
-            // Write back the temprorary buffer to the original input
-            std::copy(tmp.begin(), tmp.end(),
-                      begin + secondary_bucket_start_off);
+            if constexpr (Unique) {
+              // Finish sorting the bucket, which holds all the copies of its
+              // keys, and write back only the distinct ones
+              learned_sort::utils::insertion_sort(tmp.begin(), tmp.end(), comp);
+              num_unique_elms =
+                  std::copy(tmp.begin(), std::unique(tmp.begin(), tmp.end()),
+                            begin + num_unique_elms) -
+                  begin;
+            } else {
+              // Write back the temprorary buffer to the original input
+              std::copy(tmp.begin(), tmp.end(),
+                        begin + secondary_bucket_start_off);
+            }
+          } else if constexpr (Unique) {
+            begin[num_unique_elms++] = begin[secondary_bucket_start_off];
           }
           // Update the number of finalized elements
           num_elms_finalized += secondary_bucket_sz;
@@ -958,78 +1119,483 @@ void sort(RandomIt begin, RandomIt end,
 
       }  // end of processing for non-flagged, non-homogeneous primary buckets
     }    // end of iteration over primary buckets
+    state.next_bucket = last_bucket;
   }
+  if (state.next_bucket < PRIMARY_FANOUT) return end;
 
   // Touch up
-  learned_sort::utils::insertion_sort(begin, end);
+  if constexpr (Unique) {
+    end = begin + num_unique_elms;
+  }
+  learned_sort::utils::insertion_sort(begin, end, comp);
+
+  // The copies of a key can only be split across buckets when the prediction
+  // for it is not reproducible (e.g., under different floating-point
+  // contraction), in which case they are adjacent after the touch up
+  if constexpr (Unique) {
+    end = std::unique(begin, end);
+  }
+  return end;
 }
 
 /**
- * @brief Sorts a sequence of numerical keys from [begin, end) using Learned
- * Sort, in ascending order.
+ * @brief Sorts [begin, end) with a trained CDF model, in the given order.
  *
- * @tparam RandomIt A bi-directional random iterator over the sequence of keys
- * @param begin Random-access iterators to the initial position of the
- * sequence to be used for sorting. The range used is [begin,end), which
- * contains all the elements between first and last, including the element
- * pointed by first but not the element pointed by last.
- * @param end Random-access iterators to the last position of the sequence to
- * be used for sorting. The range used is [begin,end), which contains all the
- * elements between first and last, including the element pointed by first but
- * not the element pointed by last.
- * @param params The hyperparameters for the CDF model, which describe the
- * architecture and sampling ratio.
+ * When `Unique` is set, only the first of each group of equal keys is kept,
+ * and the distinct keys are compacted at the beginning of the range. Since the
+ * model always predicts the same buckets for equal keys, they are collapsed
+ * bucket by bucket, as each bucket is finalized, and the duplicates are never
+ * written back.
+ *
+ * @return The end of the sorted keys, which is `end` unless `Unique` is set
  */
-template <class RandomIt>
-void sort(
+template <order Order = order::ascending, bool Unique = false, class RandomIt,
+          class P>
+RandomIt sort(
+    RandomIt begin, RandomIt end,
+    TwoLayerRMI<typename iterator_traits<RandomIt>::value_type, P> &rmi) {
+  sort_state<P> state(rmi.resource);
+  return sort_step<Order, Unique>(begin, end, rmi, state, PRIMARY_FANOUT);
+}
+
+/**
+ * @brief Estimates the presortedness of [begin, end) as the fraction of
+ * adjacent keys that are out of order w.r.t. `comp`, i.e., the number of
+ * sorted runs per key, from a sample of evenly spaced pairs.
+ */
+template <class RandomIt, class Compare>
+double sampled_descent_ratio(RandomIt begin, RandomIt end, Compare comp) {
+  const long input_sz = std::distance(begin, end);
+  const long sample_sz = std::min(PRESORTEDNESS_SAMPLE_SZ, input_sz - 1);
+  if (sample_sz <= 0) return 0;
+
+  long num_descents = 0;
+  for (long i = 0; i < sample_sz; ++i) {
+    const auto pair = begin + i * (input_sz - 1) / sample_sz;
+    num_descents += comp(pair[1], pair[0]);
+  }
+  return static_cast<double>(num_descents) / sample_sz;
+}
+
+/**
+ * @brief Finds the maximal sorted runs of [begin, end) w.r.t. `comp`, and
+ * stores their boundaries in `run_bounds`, such that run i spans the offsets
+ * [run_bounds[i], run_bounds[i + 1]).
+ *
+ * @return false, as soon as more than `max_runs` runs are found
+ */
+template <class RandomIt, class Compare>
+bool find_runs(RandomIt begin, RandomIt end, Compare comp, long max_runs,
+               std::pmr::vector<long> &run_bounds) {
+  const long input_sz = std::distance(begin, end);
+
+  run_bounds.assign(1, 0);
+  for (long i = 1; i < input_sz; ++i) {
+    if (comp(begin[i], begin[i - 1])) {
+      if (static_cast<long>(run_bounds.size()) == max_runs) return false;
+      run_bounds.push_back(i);
+    }
+  }
+  run_bounds.push_back(input_sz);
+  return true;
+}
+
+/**
+ * @brief Merges adjacent pairs of the sorted pieces in `src` into `dst`, where
+ * piece i spans the offsets [bounds[i], bounds[i + 1]) in both, and updates
+ * `bounds` to the merged pieces.
+ */
+template <class SrcIt, class DstIt, class Compare>
+void merge_piece_pairs(SrcIt src, DstIt dst, std::pmr::vector<long> &bounds,
+                       Compare comp) {
+  const long num_pieces = bounds.size() - 1;
+  long num_merged = 0;
+  for (long i = 0; i < num_pieces; i += 2) {
+    if (i + 1 < num_pieces) {
+      learned_sort::utils::branchless_merge(
+          src + bounds[i], src + bounds[i + 1], src + bounds[i + 1],
+          src + bounds[i + 2], dst + bounds[i], comp);
+    } else {
+      std::copy(src + bounds[i], src + bounds[i + 1], dst + bounds[i]);
+    }
+    bounds[++num_merged] = bounds[std::min(i + 2, num_pieces)];
+  }
+  bounds.resize(num_merged + 1);
+}
+
+/**
+ * @brief Merges the sorted runs [runs[i].first, runs[i].second) into the range
+ * beginning at `out`, which may hold the runs themselves.
+ *
+ * The output is split into segments of roughly equal size, each of which is
+ * merged on its own thread. The segment boundaries are quantiles of a sample
+ * that is drawn from all the runs, and on which a CDF model is trained. Every
+ * run is cut at the splitter key of each quantile by an exponential search,
+ * which starts from the position that the model predicts for the splitter in
+ * the run. Within a segment, the pieces of the runs are merged pairwise, back
+ * and forth between the output and a buffer of the same size.
+ *
+ * @param num_threads The number of threads to merge the segments on
+ */
+template <order Order, class RunIt, class RandomIt>
+void merge_run_ranges(
+    const std::pmr::vector<std::pair<RunIt, RunIt>> &runs, RandomIt out,
+    typename TwoLayerRMI<typename iterator_traits<RunIt>::value_type>::Params
+        &params,
+    std::pmr::memory_resource *resource, long num_threads) {
+  // Determine the data type
+  typedef typename iterator_traits<RunIt>::value_type T;
+
+  const long num_runs = runs.size();
+  const order_comparator<Order> comp;
+
+  long output_sz = 0;
+  for (const auto &[run_begin, run_end] : runs) {
+    output_sz += run_end - run_begin;
+  }
+  if (output_sz == 0) return;
+
+  // Train the CDF model on a sample that is drawn from every run in proportion
+  // to its size
+  long num_segments =
+      std::max(1L, std::min(num_threads, output_sz / MIN_MERGE_SEGMENT_SZ));
+  TwoLayerRMI<T> rmi(params, resource);
+  std::pmr::vector<T> sample(resource);
+  if (num_segments > 1) {
+    // The sample must be large enough for the threshold to be valid on it
+    const long sample_sz = std::min<long>(
+        output_sz, std::max<long>(params.sampling_rate * output_sz,
+                                  2 * params.fanout * params.threshold));
+    sample.reserve(sample_sz + num_runs);
+    for (const auto &[run_begin, run_end] : runs) {
+      const long run_sz = run_end - run_begin;
+      const long run_sample_sz =
+          (run_sz * sample_sz + output_sz - 1) / output_sz;
+      for (long i = 0; i < run_sample_sz; ++i) {
+        sample.push_back(run_begin[i * run_sz / run_sample_sz]);
+      }
+    }
+
+    std::sort(sample.begin(), sample.end(), comp);
+
+    // The model is trained on the whole sample
+    rmi.hp.sampling_rate = 1;
+    if (!rmi.train(sample.begin(), sample.end())) num_segments = 1;
+  }
+
+  // The offsets in every run where each segment starts: run r is cut for
+  // segment j at cuts[j * num_runs + r]
+  std::pmr::vector<long> cuts((num_segments + 1) * num_runs, resource);
+  for (long r = 0; r < num_runs; ++r) {
+    cuts[num_segments * num_runs + r] = runs[r].second - runs[r].first;
+  }
+
+  if (num_segments > 1) {
+    // The CDF in the sort direction
+    auto cdf = [&](const T &key) {
+      const double pred_cdf = rmi.predict(key);
+      return Order == order::ascending ? pred_cdf : 1 - pred_cdf;
+    };
+
+    for (long j = 1; j < num_segments; ++j) {
+      const T splitter = sample[j * sample.size() / num_segments];
+
+      // Cut every run at the splitter, starting from the position that the
+      // model predicts for it in the run
+      for (long r = 0; r < num_runs; ++r) {
+        const auto &[run_begin, run_end] = runs[r];
+        const long run_sz = run_end - run_begin;
+        if (run_sz == 0) continue;
+        const double first_cdf = cdf(run_begin[0]);
+        const double last_cdf = cdf(run_end[-1]);
+
+        long pred_pos = 0;
+        if (last_cdf > first_cdf) {
+          pred_pos = static_cast<long>(std::max(
+              0., std::min<double>(run_sz, (cdf(splitter) - first_cdf) /
+                                               (last_cdf - first_cdf) *
+                                               run_sz)));
+        }
+        cuts[j * num_runs + r] =
+            learned_sort::utils::exponential_lower_bound(
+                run_begin, run_end, run_begin + pred_pos, splitter, comp) -
+            run_begin;
+      }
+    }
+  }
+
+  // The offsets in the output where each segment starts
+  std::pmr::vector<long> segment_offsets(num_segments + 1, resource);
+  for (long j = 1; j <= num_segments; ++j) {
+    segment_offsets[j] = segment_offsets[j - 1];
+    for (long r = 0; r < num_runs; ++r) {
+      segment_offsets[j] +=
+          cuts[j * num_runs + r] - cuts[(j - 1) * num_runs + r];
+    }
+  }
+
+  learned_sort::utils::scratch_buffer<T> buf(output_sz, resource);
+  std::pmr::vector<std::pmr::vector<long>> piece_bounds(num_segments,
+                                                        resource);
+
+  // Merge the adjacent pairs of the runs' pieces of each segment into the
+  // buffer. All the segments must be done before the output is written, since
+  // it may hold the runs.
+  learned_sort::utils::parallel_for(
+      num_segments, num_segments, [&](long j) {
+        auto &bounds = piece_bounds[j];
+        auto piece_begin = [&](long r) {
+          return runs[r].first + cuts[j * num_runs + r];
+        };
+        auto piece_end = [&](long r) {
+          return runs[r].first + cuts[(j + 1) * num_runs + r];
+        };
+
+        auto buf_itr = buf.data() + segment_offsets[j];
+        bounds.push_back(segment_offsets[j]);
+
+        long pending_run = -1;
+        for (long r = 0; r < num_runs; ++r) {
+          if (piece_begin(r) == piece_end(r)) continue;
+          if (pending_run < 0) {
+            pending_run = r;
+            continue;
+          }
+          buf_itr = learned_sort::utils::branchless_merge(
+              piece_begin(pending_run), piece_end(pending_run), piece_begin(r),
+              piece_end(r), buf_itr, comp);
+          bounds.push_back(buf_itr - buf.data());
+          pending_run = -1;
+        }
+        if (pending_run >= 0) {
+          buf_itr = std::copy(piece_begin(pending_run), piece_end(pending_run),
+                              buf_itr);
+          bounds.push_back(buf_itr - buf.data());
+        }
+      });
+
+  // Merge the rest of the pieces of each segment, and write it to the output
+  learned_sort::utils::parallel_for(
+      num_segments, num_segments, [&](long j) {
+        auto &bounds = piece_bounds[j];
+        bool in_buf = true;
+        while (bounds.size() > 2) {
+          if (in_buf) {
+            merge_piece_pairs(buf.data(), out, bounds, comp);
+          } else {
+            merge_piece_pairs(out, buf.data(), bounds, comp);
+          }
+          in_buf = !in_buf;
+        }
+        if (in_buf) {
+          std::copy(buf.data() + bounds.front(), buf.data() + bounds.back(),
+                    out + bounds.front());
+        }
+      });
+}
+
+/**
+ * @brief Merges a sequence of sorted runs into a single sorted sequence that
+ * starts at `out`, using a CDF model to split the merge evenly across threads.
+ *
+ * A TwoLayerRMI is trained on a sample drawn from all the runs, and every run
+ * is cut at the same quantiles of its CDF, so that the segments of the output
+ * between two quantiles are merged independently, each on its own thread.
+ *
+ * @tparam Order The direction in which the runs, and the output, are sorted
+ * @param runs A range of sorted ranges of keys, e.g., a vector of vectors or
+ * of spans. They must not overlap the output.
+ * @param out A random-access iterator to the beginning of the output, which
+ * has room for all the keys of the runs
+ * @param resource The memory resource for the CDF model and the auxiliary
+ * buffers. Defaults to the one set with utils::set_scratch_resource().
+ * @param num_threads The number of threads to merge on. Defaults to the number
+ * of hardware threads.
+ */
+template <order Order = order::ascending, class Runs, class RandomIt>
+void merge_runs(const Runs &runs, RandomIt out,
+                std::pmr::memory_resource *resource =
+                    learned_sort::utils::scratch_resource(),
+                long num_threads = learned_sort::utils::default_num_threads()) {
+  typedef std::ranges::iterator_t<const std::ranges::range_value_t<Runs>>
+      RunIt;
+  typedef typename iterator_traits<RunIt>::value_type T;
+
+  std::pmr::vector<std::pair<RunIt, RunIt>> run_ranges(resource);
+  for (const auto &run : runs) {
+    run_ranges.emplace_back(std::ranges::begin(run), std::ranges::end(run));
+  }
+
+  typename TwoLayerRMI<T>::Params params;
+  merge_run_ranges<Order>(run_ranges, out, params, resource, num_threads);
+}
+
+/**
+ * @brief Sorts [begin, end) in the given order without a CDF model, when the
+ * keys are already sorted in either order, too few to train a model on, or
+ * consist of a few sorted runs, which are merged instead.
+ *
+ * @return Whether the keys were sorted
+ */
+template <order Order, class RandomIt>
+bool sort_without_model(
     RandomIt begin, RandomIt end,
     typename TwoLayerRMI<typename iterator_traits<RandomIt>::value_type>::Params
-        &params) {
+        &params,
+    std::pmr::memory_resource *resource) {
+  const order_comparator<Order> comp;
+
   // Check if the data is already sorted
-  if (*(end - 1) >= *begin && std::is_sorted(begin, end)) {
-    return;
+  if (!comp(*(end - 1), *begin) && std::is_sorted(begin, end, comp)) {
+    return true;
   }
 
-  // Check if the data is sorted in descending order
-  if (*(end - 1) <= *begin) {
+  // Check if the data is sorted in the opposite order
+  if (!comp(*begin, *(end - 1))) {
     auto is_reverse_sorted = true;
 
     for (auto i = begin; i != end - 1; ++i) {
-      if (*i < *(i + 1)) {
+      if (comp(*i, *(i + 1))) {
         is_reverse_sorted = false;
+        break;
       }
     }
 
     if (is_reverse_sorted) {
       std::reverse(begin, end);
-      return;
+      return true;
     }
   }
 
   if (std::distance(begin, end) <=
       std::max<long>(params.fanout * params.threshold,
                      5 * params.num_leaf_models)) {
-    std::sort(begin, end);
+    std::sort(begin, end, comp);
+    return true;
+  }
+
+  // Merge the sorted runs of nearly-sorted inputs
+  if (sampled_descent_ratio(begin, end, comp) <= MAX_SAMPLED_DESCENT_RATIO) {
+    std::pmr::vector<long> run_bounds(resource);
+    if (find_runs(begin, end, comp, MAX_MERGED_RUNS, run_bounds)) {
+      std::pmr::vector<std::pair<RandomIt, RandomIt>> runs(resource);
+      for (size_t r = 0; r + 1 < run_bounds.size(); ++r) {
+        runs.emplace_back(begin + run_bounds[r], begin + run_bounds[r + 1]);
+      }
+      merge_run_ranges<Order>(runs, begin, params, resource,
+                              learned_sort::utils::default_num_threads());
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Returns whether the keys in [begin, end) can be sorted with the
+ * trained `rmi` in single precision, i.e., when they are 4-byte keys, and the
+ * model's error bound shows that it would not displace them.
+ */
+template <class RandomIt>
+bool use_float_inference(
+    const TwoLayerRMI<typename iterator_traits<RandomIt>::value_type> &rmi,
+    RandomIt begin, RandomIt end) {
+  if constexpr (sizeof(typename iterator_traits<RandomIt>::value_type) <=
+                sizeof(float)) {
+    return rmi.template precision_error<float>(begin, end) *
+               std::distance(begin, end) <=
+           MAX_FLOAT_INFERENCE_DISPLACEMENT;
   } else {
-    // Initialize the RMI
-    TwoLayerRMI<typename iterator_traits<RandomIt>::value_type> rmi(params);
+    return false;
+  }
+}
 
-    // Check if the model can be trained
-    if (rmi.train(begin, end)) {
-      // Sort the data if the model was successfully trained
-      learned_sort::sort(begin, end, rmi);
+/**
+ * @brief Sorts a sequence of numerical keys from [begin, end) using Learned
+ * Sort, in ascending order, or in descending order when `Order` is
+ * order::descending.
+ *
+ * Inputs that are nearly sorted, e.g., that consist of a few concatenated
+ * sorted runs, are detected from a sample, and their runs are merged instead.
+ *
+ * @tparam Order The direction in which the keys are sorted
+ * @tparam RandomIt A bi-directional random iterator over the sequence of keys
+ * @param begin Random-access iterators to the initial position of the
+ * sequence to be used for sorting. The range used is [begin,end), which
+ * contains all the elements between first and last, including the element
+ * pointed by first but not the element pointed by last.
+ * @param end Random-access iterators to the last position of the sequence to
+ * be used for sorting. The range used is [begin,end), which contains all the
+ * elements between first and last, including the element pointed by first but
+ * not the element pointed by last.
+ * @param params The hyperparameters for the CDF model, which describe the
+ * architecture and sampling ratio.
+ * @param resource The memory resource for the CDF model and the auxiliary
+ * buffers. Defaults to the one set with utils::set_scratch_resource().
+ * @param trained_rmi If not null, the CDF model that is trained for the sort,
+ * so that it can be reused after it (see sort_with_index()). It is left
+ * untrained when the keys are sorted without a model.
+ * @return The end of the sorted keys, which is `end` unless `Unique` is set,
+ * in which case only the distinct keys are kept (see sort_unique())
+ */
+template <order Order = order::ascending, bool Unique = false, class RandomIt>
+RandomIt sort(
+    RandomIt begin, RandomIt end,
+    typename TwoLayerRMI<typename iterator_traits<RandomIt>::value_type>::Params
+        &params,
+    std::pmr::memory_resource *resource =
+        learned_sort::utils::scratch_resource(),
+    TwoLayerRMI<typename iterator_traits<RandomIt>::value_type> *trained_rmi =
+        nullptr) {
+  const order_comparator<Order> comp;
+
+  // Removes the duplicates of the keys in [begin, sorted_end) when requested,
+  // for the paths that do not collapse them while sorting
+  auto finish = [&](RandomIt sorted_end) {
+    if constexpr (Unique) {
+      return std::unique(begin, sorted_end);
+    } else {
+      return sorted_end;
     }
+  };
+
+  if (sort_without_model<Order>(begin, end, params, resource)) {
+    return finish(end);
+  }
 
-    else {  // Fall back in case the model could not be trained
-      std::sort(begin, end);
+  // Determine the data type
+  typedef typename iterator_traits<RandomIt>::value_type T;
+
+  // Initialize the RMI, unless the caller provided one
+  TwoLayerRMI<T> own_rmi(params, resource);
+  TwoLayerRMI<T> &rmi = trained_rmi ? *trained_rmi : own_rmi;
+
+  // Check if the model can be trained
+  if (rmi.train(begin, end)) {
+    // Perform inference in single precision when it is accurate enough
+    if (use_float_inference(rmi, begin, end)) {
+      TwoLayerRMI<T, float> float_rmi(rmi);
+      auto sorted_end =
+          learned_sort::sort<Order, Unique>(begin, end, float_rmi);
+      rmi.bucket_fill = float_rmi.bucket_fill;
+      return sorted_end;
     }
+
+    // Sort the data if the model was successfully trained
+    return learned_sort::sort<Order, Unique>(begin, end, rmi);
+  }
+
+  else {  // Fall back in case the model could not be trained
+    std::sort(begin, end, comp);
+    return finish(end);
   }
 }
 
 /**
  * @brief Sorts a sequence of numerical keys from [begin, end) using Learned
- * Sort, in ascending order.
+ * Sort, in ascending order, or in descending order when `Order` is
+ * order::descending.
  *
+ * @tparam Order The direction in which the keys are sorted
  * @tparam RandomIt A bi-directional random iterator over the sequence of keys
  * @param begin Random-access iterators to the initial position of the
  * sequence to be used for sorting. The range used is [begin,end), which
@@ -1040,12 +1606,165 @@ void sort(
  * elements between first and last, including the element pointed by first but
  * not the element pointed by last.
  */
-template <class RandomIt>
+template <order Order = order::ascending, class RandomIt>
 void sort(RandomIt begin, RandomIt end) {
   if (begin != end) {
     typename TwoLayerRMI<typename iterator_traits<RandomIt>::value_type>::Params
         p;
-    learned_sort::sort(begin, end, p);
+    learned_sort::sort<Order>(begin, end, p);
+  }
+}
+
+/**
+ * @brief Sorts a sequence of numerical keys from [begin, end) using Learned
+ * Sort, in the given order, allocating all the memory that it needs from the
+ * given memory resource.
+ *
+ * @tparam Order The direction in which the keys are sorted
+ * @tparam RandomIt A bi-directional random iterator over the sequence of keys
+ * @param begin Random-access iterators to the initial position of the
+ * sequence to be used for sorting.
+ * @param end Random-access iterators to the last position of the sequence to
+ * be used for sorting.
+ * @param resource The memory resource for the CDF model and the auxiliary
+ * buffers.
+ */
+template <order Order = order::ascending, class RandomIt>
+void sort(RandomIt begin, RandomIt end, std::pmr::memory_resource *resource) {
+  if (begin != end) {
+    typename TwoLayerRMI<typename iterator_traits<RandomIt>::value_type>::Params
+        p;
+    learned_sort::sort<Order>(begin, end, p, resource);
+  }
+}
+
+/**
+ * @brief Sorts a sequence of numerical keys from [begin, end) using Learned
+ * Sort, in the given order, and removes the duplicate keys, like std::sort
+ * followed by std::unique. The duplicates are collapsed as each bucket of the
+ * sort is finalized, so they are never written back to the input.
+ *
+ * @tparam Order The direction in which the keys are sorted
+ * @tparam RandomIt A bi-directional random iterator over the sequence of keys
+ * @param begin Random-access iterators to the initial position of the
+ * sequence to be used for sorting.
+ * @param end Random-access iterators to the last position of the sequence to
+ * be used for sorting.
+ * @param resource The memory resource for the CDF model and the auxiliary
+ * buffers. Defaults to the one set with utils::set_scratch_resource().
+ * @return The end of the distinct keys, which are placed in order at the
+ * beginning of the range. The keys after it are unspecified.
+ */
+template <order Order = order::ascending, class RandomIt>
+RandomIt sort_unique(RandomIt begin, RandomIt end,
+                     std::pmr::memory_resource *resource =
+                         learned_sort::utils::scratch_resource()) {
+  if (begin == end) return end;
+
+  typename TwoLayerRMI<typename iterator_traits<RandomIt>::value_type>::Params
+      p;
+  return learned_sort::sort<Order, true>(begin, end, p, resource);
+}
+
+/**
+ * @brief Counts the distinct keys in [begin, end) with sort_unique(), which
+ * leaves them in ascending order at the beginning of the range.
+ *
+ * @param resource The memory resource for the CDF model and the auxiliary
+ * buffers. Defaults to the one set with utils::set_scratch_resource().
+ */
+template <class RandomIt>
+long count_distinct(RandomIt begin, RandomIt end,
+                    std::pmr::memory_resource *resource =
+                        learned_sort::utils::scratch_resource()) {
+  return std::distance(begin, learned_sort::sort_unique(begin, end, resource));
+}
+
+/**
+ * @brief Sorts a sequence of floating-point keys from [begin, end) using
+ * Learned Sort, in the IEEE 754 total order, where -NaN < -inf < ... < -0.0 <
+ * +0.0 < ... < +inf < +NaN, or in the reverse of that order when `Order` is
+ * order::descending.
+ *
+ * The keys are mapped to order-preserving unsigned integers (see
+ * utils::float_flip), which are sorted and mapped back. The negative and the
+ * positive keys are sorted separately, as are the infinities and NaNs. Besides
+ * giving NaNs and signed zeros a defined placement, the integer representation
+ * grows roughly with the logarithm of the keys' magnitude, so the CDF model
+ * fits heavy-tailed distributions (e.g., lognormal or exponential) better. The
+ * integers are kept in a buffer of the same size as the input. Integer keys
+ * are sorted as usual.
+ *
+ * @tparam Order The direction in which the keys are sorted
+ * @tparam RandomIt A bi-directional random iterator over the sequence of keys
+ * @param begin Random-access iterators to the initial position of the
+ * sequence to be used for sorting.
+ * @param end Random-access iterators to the last position of the sequence to
+ * be used for sorting.
+ * @param resource The memory resource for the CDF model and the auxiliary
+ * buffers. Defaults to the one set with utils::set_scratch_resource().
+ */
+template <order Order = order::ascending, class RandomIt>
+void sort_total_order(RandomIt begin, RandomIt end,
+                      std::pmr::memory_resource *resource =
+                          learned_sort::utils::scratch_resource()) {
+  // Determine the data type
+  typedef typename iterator_traits<RandomIt>::value_type T;
+
+  if constexpr (!std::is_floating_point_v<T>) {
+    learned_sort::sort<Order>(begin, end, resource);
+  } else {
+    typedef learned_sort::utils::flipped_t<T> U;
+    using learned_sort::utils::float_flip;
+
+    // The keys fall into four groups, which are contiguous in the total order:
+    // (0) -NaN and -inf, (1) negative finite keys, (2) positive finite keys,
+    // and (3) +inf and +NaN. Each group is sorted separately, so that the
+    // outliers and the gap between the signs do not skew the CDF model. In
+    // descending order, the groups are laid out from the last to the first.
+    constexpr int NUM_GROUPS = 4;
+    const U group_bounds[NUM_GROUPS - 1] = {
+        float_flip(-std::numeric_limits<T>::infinity()) + 1,
+        float_flip(T(-0.)) + 1,
+        float_flip(std::numeric_limits<T>::infinity())};
+    auto group_of = [&](U bits) {
+      const int group = (bits >= group_bounds[0]) + (bits >= group_bounds[1]) +
+                        (bits >= group_bounds[2]);
+      return Order == order::ascending ? group : NUM_GROUPS - 1 - group;
+    };
+
+    // Count the keys in each group
+    long group_offsets[NUM_GROUPS + 1]{0};
+    for (auto it = begin; it != end; ++it) {
+      ++group_offsets[group_of(float_flip(*it)) + 1];
+    }
+    for (int group = 1; group <= NUM_GROUPS; ++group) {
+      group_offsets[group] += group_offsets[group - 1];
+    }
+
+    // Map the keys to integers, and place them in their groups
+    std::pmr::vector<U> flipped(std::distance(begin, end), resource);
+    long write_offsets[NUM_GROUPS];
+    std::copy(group_offsets, group_offsets + NUM_GROUPS, write_offsets);
+    for (auto it = begin; it != end; ++it) {
+      const U bits = float_flip(*it);
+      flipped[write_offsets[group_of(bits)]++] = bits;
+    }
+
+    // Sort the integers. The special values are few, so std::sort them.
+    const auto flipped_begin = flipped.begin();
+    const order_comparator<Order> comp;
+    std::sort(flipped_begin, flipped_begin + group_offsets[1], comp);
+    learned_sort::sort<Order>(flipped_begin + group_offsets[1],
+                              flipped_begin + group_offsets[2], resource);
+    learned_sort::sort<Order>(flipped_begin + group_offsets[2],
+                              flipped_begin + group_offsets[3], resource);
+    std::sort(flipped_begin + group_offsets[3], flipped.end(), comp);
+
+    // Map the integers back to the keys
+    std::transform(flipped.begin(), flipped.end(), begin, [](U bits) {
+      return learned_sort::utils::float_unflip<T>(bits);
+    });
   }
 }
 
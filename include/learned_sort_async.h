@@ -0,0 +1,252 @@
+#pragma once
+
+/**
+ * @file learned_sort_async.h
+ * @brief A resumable interface to Learned Sort, which runs a sort in steps as
+ * a C++20 coroutine, so that it can be interleaved with other work on a
+ * cooperative scheduler, report its progress, and be cancelled.
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo <anikristo@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory_resource>
+#include <tuple>
+#include <utility>
+
+#include "learned_sort.h"
+#include "rmi.h"
+#include "utils.h"
+
+namespace learned_sort {
+
+// The minimum number of keys that a sort_task sorts between two suspensions,
+// once they are partitioned into the primary buckets
+static constexpr long SORT_TASK_STEP_SZ = 1 << 18;
+
+// The phases of a sort_task, which it continues with when it is resumed
+enum class sort_phase {
+  training,
+  partitioning,
+  sorting_buckets,
+  done,
+  cancelled
+};
+
+/**
+ * @brief A sort that is suspended between its steps, i.e., after training the
+ * CDF model, after partitioning the keys into the primary buckets, and after
+ * sorting every group of primary buckets of about SORT_TASK_STEP_SZ keys. It
+ * does not run until it is resumed, and it runs on the thread that resumes it.
+ *
+ * Whenever the sort is suspended, the range holds all of its keys, so it can
+ * be cancelled, and the range is left in an unspecified order.
+ */
+class sort_task {
+ public:
+  struct promise_type {
+    sort_phase phase = sort_phase::training;
+    double progress = 0;
+    std::exception_ptr exception;
+
+    // Allocates the coroutine frame from the memory resource of the sort,
+    // which is the last argument of the coroutine, and records it before the
+    // frame for deallocating it
+    template <class... Args>
+    static void *operator new(std::size_t sz, const Args &...args) {
+      std::pmr::memory_resource *resource =
+          std::get<sizeof...(Args) - 1>(std::tie(args...));
+      void *mem = resource->allocate(sz + FRAME_HEADER_SZ, FRAME_ALIGNMENT);
+      *static_cast<std::pmr::memory_resource **>(mem) = resource;
+      return static_cast<char *>(mem) + FRAME_HEADER_SZ;
+    }
+
+    static void operator delete(void *frame, std::size_t sz) {
+      void *mem = static_cast<char *>(frame) - FRAME_HEADER_SZ;
+      (*static_cast<std::pmr::memory_resource **>(mem))
+          ->deallocate(mem, sz + FRAME_HEADER_SZ, FRAME_ALIGNMENT);
+    }
+
+    sort_task get_return_object() {
+      return sort_task(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(std::pair<sort_phase, double> step) {
+      std::tie(phase, progress) = step;
+      return {};
+    }
+    void return_void() {
+      phase = sort_phase::done;
+      progress = 1;
+    }
+    void unhandled_exception() { exception = std::current_exception(); }
+
+   private:
+    static constexpr std::size_t FRAME_ALIGNMENT =
+        __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+    static constexpr std::size_t FRAME_HEADER_SZ = FRAME_ALIGNMENT;
+  };
+
+  sort_task(sort_task &&other) noexcept
+      : handle(std::exchange(other.handle, nullptr)),
+        is_cancelled(other.is_cancelled) {}
+
+  sort_task &operator=(sort_task &&other) noexcept {
+    if (this != &other) {
+      if (handle) handle.destroy();
+      handle = std::exchange(other.handle, nullptr);
+      is_cancelled = other.is_cancelled;
+    }
+    return *this;
+  }
+
+  ~sort_task() {
+    if (handle) handle.destroy();
+  }
+
+  /**
+   * @brief Runs the sort until its next suspension, and rethrows any exception
+   * that it threw.
+   *
+   * @return Whether the sort has more steps to run
+   */
+  bool resume() {
+    if (done()) return false;
+    handle.resume();
+    if (handle.promise().exception) {
+      std::rethrow_exception(handle.promise().exception);
+    }
+    return !handle.done();
+  }
+
+  // Runs the rest of the sort
+  void run() {
+    while (resume()) {
+    }
+  }
+
+  // Stops the sort, and releases its memory. The range holds all of its keys,
+  // in an unspecified order.
+  void cancel() {
+    if (done()) return;
+    handle.destroy();
+    handle = nullptr;
+    is_cancelled = true;
+  }
+
+  bool done() const { return !handle || handle.done(); }
+
+  sort_phase phase() const {
+    if (!handle) return is_cancelled ? sort_phase::cancelled : sort_phase::done;
+    return handle.promise().phase;
+  }
+
+  // Returns the fraction of the keys that are in their final position
+  double progress() const {
+    if (!handle) return is_cancelled ? 0 : 1;
+    return handle.promise().progress;
+  }
+
+ private:
+  explicit sort_task(std::coroutine_handle<promise_type> handle)
+      : handle(handle) {}
+
+  std::coroutine_handle<promise_type> handle;
+  bool is_cancelled = false;
+};
+
+/**
+ * @brief Sorts [begin, end) with the trained `rmi` in steps (see sort_step()),
+ * which it is suspended between.
+ */
+template <order Order, class RandomIt, class P>
+sort_task sort_steps(
+    RandomIt begin, RandomIt end,
+    TwoLayerRMI<typename iterator_traits<RandomIt>::value_type, P> &rmi,
+    std::pmr::memory_resource *resource) {
+  const long input_sz = std::distance(begin, end);
+  sort_state<P> state(resource);
+
+  // Partition the keys
+  learned_sort::sort_step<Order, false>(begin, end, rmi, state, 0);
+  co_yield {sort_phase::sorting_buckets, 0.};
+
+  // Sort the primary buckets in groups
+  while (true) {
+    long last_bucket = state.next_bucket;
+    long group_sz = 0;
+    while (last_bucket < PRIMARY_FANOUT && group_sz < SORT_TASK_STEP_SZ) {
+      group_sz += state.primary_bucket_sizes[last_bucket++];
+    }
+    learned_sort::sort_step<Order, false>(begin, end, rmi, state, last_bucket);
+    if (last_bucket == PRIMARY_FANOUT) break;
+    co_yield {sort_phase::sorting_buckets,
+              static_cast<double>(state.num_elms_finalized) / input_sz};
+  }
+}
+
+/**
+ * @brief Sorts a sequence of numerical keys from [begin, end) using Learned
+ * Sort, in the given order, as a sort_task that runs a step of the sort each
+ * time it is resumed (see sort()).
+ *
+ * @tparam Order The direction in which the keys are sorted
+ * @param resource The memory resource for the coroutine, the CDF model and
+ * the auxiliary buffers. Defaults to the one set with
+ * utils::set_scratch_resource().
+ */
+template <order Order = order::ascending, class RandomIt>
+sort_task sort_async(RandomIt begin, RandomIt end,
+                     std::pmr::memory_resource *resource =
+                         learned_sort::utils::scratch_resource()) {
+  // Determine the data type
+  typedef typename iterator_traits<RandomIt>::value_type T;
+
+  if (begin == end) co_return;
+  typename TwoLayerRMI<T>::Params params;
+  if (sort_without_model<Order>(begin, end, params, resource)) co_return;
+
+  // Fall back in case the model could not be trained
+  TwoLayerRMI<T> rmi(params, resource);
+  if (!rmi.train(begin, end)) {
+    std::sort(begin, end, order_comparator<Order>());
+    co_return;
+  }
+  co_yield {sort_phase::partitioning, 0.};
+
+  // Run the steps with the model in the precision that the sort would use
+  if constexpr (sizeof(T) <= sizeof(float)) {
+    if (use_float_inference(rmi, begin, end)) {
+      TwoLayerRMI<T, float> float_rmi(rmi);
+      auto steps = sort_steps<Order>(begin, end, float_rmi, resource);
+      while (steps.resume()) {
+        co_yield {steps.phase(), steps.progress()};
+      }
+      co_return;
+    }
+  }
+  auto steps = sort_steps<Order>(begin, end, rmi, resource);
+  while (steps.resume()) {
+    co_yield {steps.phase(), steps.progress()};
+  }
+}
+
+}  // namespace learned_sort
@@ -0,0 +1,292 @@
+#pragma once
+
+/**
+ * @file learned_sort_columns.h
+ * @brief Sorts the rows of a table that is stored as separate columns, in
+ * lexicographic order of their keys in the columns, without building the rows.
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo <anikristo@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <memory_resource>
+#include <numeric>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "learned_sort.h"
+#include "rmi.h"
+#include "utils.h"
+
+namespace learned_sort {
+
+// The maximum number of rows in a group that is sorted by comparing its rows,
+// instead of partitioning it column by column
+static constexpr long MAX_ROW_COMPARISON_SORT_SZ = 64;
+
+/**
+ * @brief Returns whether the row at offset `a` is before the row at offset `b`
+ * in lexicographic order of their keys in column `Col` and the ones after it.
+ */
+template <order Order, size_t Col, class Columns>
+bool row_before(const Columns &columns, long a, long b) {
+  const order_comparator<Order> comp;
+  const auto column = std::get<Col>(columns);
+  if (comp(column[a], column[b])) return true;
+  if (comp(column[b], column[a])) return false;
+  if constexpr (Col + 1 < std::tuple_size_v<Columns>) {
+    return row_before<Order, Col + 1>(columns, a, b);
+  } else {
+    return false;
+  }
+}
+
+/**
+ * @brief Sorts the `num_rows` rows in `perm`, which tie on all the columns
+ * before column `Col`, by their keys in column `Col`, and then sorts the rows
+ * that tie on it as well by the columns after it.
+ *
+ * The keys of the column are partitioned into buckets, along with their
+ * offsets in `perm`, with a CDF model that is trained on them. If they have too
+ * few distinct keys for a model, each of the distinct keys of a sample gets a
+ * bucket of its own instead, between the buckets of the keys that fall between
+ * them. Since the partitioning keeps the order of the input within a bucket,
+ * the buckets that are already sorted (e.g., those of a single key) are not
+ * sorted again. Small groups of rows are sorted by comparing their rows, or
+ * their keys in the column, directly.
+ *
+ * @param columns A tuple of random-access iterators to the first key of each
+ * column
+ * @param perm The offsets of the rows in the columns, in ascending order
+ */
+template <order Order, size_t Col, class Columns>
+void sort_rows_by_column(const Columns &columns, long *perm, long num_rows,
+                         long num_threads,
+                         std::pmr::memory_resource *resource) {
+  typedef std::tuple_element_t<Col, Columns> RandomIt;
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  typedef std::pair<T, long> entry_t;
+  const RandomIt column = std::get<Col>(columns);
+  const order_comparator<Order> comp;
+
+  if (num_rows <= MAX_ROW_COMPARISON_SORT_SZ) {
+    std::sort(perm, perm + num_rows, [&](long a, long b) {
+      return row_before<Order, Col>(columns, a, b) ||
+             (!row_before<Order, Col>(columns, b, a) && a < b);
+    });
+    return;
+  }
+
+  // The entries are ordered by their keys, and then by their offsets, which
+  // keeps the rows that tie on all the columns in the order of the input
+  auto entry_before = [&](const entry_t &a, const entry_t &b) {
+    return comp(a.first, b.first) ||
+           (!comp(b.first, a.first) && a.second < b.second);
+  };
+
+  // Partition the keys of the rows, along with their offsets in `perm`. The
+  // model is only trained for the groups that are large enough for it.
+  typename TwoLayerRMI<T>::Params params;
+  const long min_sz = std::max<long>(params.fanout * params.threshold,
+                                     5 * params.num_leaf_models);
+  std::optional<TwoLayerRMI<T>> rmi;
+  learned_sort::utils::scratch_buffer<entry_t> entries(num_rows, resource);
+  std::pmr::vector<long> bucket_offsets(resource);
+  {
+    std::pmr::vector<T> keys(num_rows, resource);
+    for (long i = 0; i < num_rows; ++i) keys[i] = column[perm[i]];
+
+    if (num_rows <= min_sz) {
+      for (long i = 0; i < num_rows; ++i) entries.data()[i] = {keys[i], i};
+      bucket_offsets = {0, num_rows};
+    } else if (rmi.emplace(params, resource).train(keys.begin(), keys.end())) {
+      auto bucket_of = [&](const T &key) {
+        const long bucket_idx = static_cast<long>(
+            std::max(0., std::min(PRIMARY_FANOUT - 1.,
+                                  rmi->predict(key) * PRIMARY_FANOUT)));
+        return Order == order::ascending ? bucket_idx
+                                         : PRIMARY_FANOUT - 1 - bucket_idx;
+      };
+      learned_sort::utils::partition_by_bucket(
+          keys.begin(), keys.end(), bucket_of, PRIMARY_FANOUT, entries.data(),
+          bucket_offsets, num_threads, resource);
+    } else {
+      rmi.reset();
+
+      // Find the distinct keys of a sample
+      const long offset = std::max(
+          1L, num_rows / TwoLayerRMI<T>::Params::MIN_SORTING_SIZE);
+      std::pmr::vector<T> splitters(resource);
+      for (long i = 0; i < num_rows; i += offset) splitters.push_back(keys[i]);
+      std::sort(splitters.begin(), splitters.end(), comp);
+      splitters.erase(std::unique(splitters.begin(), splitters.end(),
+                                  [&](const T &a, const T &b) {
+                                    return !comp(a, b) && !comp(b, a);
+                                  }),
+                      splitters.end());
+      const long num_splitters = splitters.size();
+
+      // The keys that are equal to the i-th splitter go to bucket 2i + 1, and
+      // the ones between the (i-1)-th and the i-th one go to bucket 2i. The
+      // splitter is found with a branchless binary search.
+      auto bucket_of = [&](const T &key) {
+        const T *base = splitters.data();
+        for (long len = num_splitters; len > 1; len -= len / 2) {
+          base += comp(base[len / 2], key) ? len / 2 : 0;
+        }
+        const long idx = base - splitters.data() + comp(*base, key);
+        return 2 * idx + (idx < num_splitters && !comp(key, splitters[idx]));
+      };
+      learned_sort::utils::partition_by_bucket(
+          keys.begin(), keys.end(), bucket_of, 2 * num_splitters + 1,
+          entries.data(), bucket_offsets, num_threads, resource);
+    }
+  }
+
+  // Sort the buckets. The buckets of the model are sorted with a counting sort
+  // on the positions that it predicts for the keys within them, which leaves
+  // them almost sorted, as in the secondary step of the sort.
+  entry_t *sorted = entries.data();
+  const long num_buckets = bucket_offsets.size() - 1;
+  learned_sort::utils::parallel_for(
+      num_buckets, num_threads, [&](long bucket_idx) {
+        entry_t *bucket = sorted + bucket_offsets[bucket_idx];
+        const long bucket_sz =
+            bucket_offsets[bucket_idx + 1] - bucket_offsets[bucket_idx];
+        if (std::is_sorted(bucket, bucket + bucket_sz, entry_before)) return;
+        if (!rmi) {
+          std::sort(bucket, bucket + bucket_sz, entry_before);
+          return;
+        }
+
+        const long cdf_bucket_idx = Order == order::ascending
+                                        ? bucket_idx
+                                        : PRIMARY_FANOUT - 1 - bucket_idx;
+        std::pmr::vector<long> pred_pos(bucket_sz, resource);
+        std::pmr::vector<long> counts(bucket_sz + 1, 0, resource);
+        for (long i = 0; i < bucket_sz; ++i) {
+          const long pos = static_cast<long>(std::max(
+              0., std::min(bucket_sz - 1.,
+                           (rmi->predict(bucket[i].first) * PRIMARY_FANOUT -
+                            cdf_bucket_idx) *
+                               bucket_sz)));
+          pred_pos[i] =
+              Order == order::ascending ? pos : bucket_sz - 1 - pos;
+          ++counts[pred_pos[i] + 1];
+        }
+        std::partial_sum(counts.begin(), counts.end(), counts.begin());
+        std::pmr::vector<entry_t> tmp(bucket_sz, resource);
+        for (long i = 0; i < bucket_sz; ++i) {
+          tmp[counts[pred_pos[i]]++] = bucket[i];
+        }
+        learned_sort::utils::insertion_sort(tmp.begin(), tmp.end(),
+                                            entry_before);
+        std::copy(tmp.begin(), tmp.end(), bucket);
+      });
+
+  // Touch up the keys that the model placed in the neighbouring buckets of
+  // their own
+  learned_sort::utils::insertion_sort(sorted, sorted + num_rows,
+                                      entry_before);
+
+  // Place the rows
+  const std::pmr::vector<long> rows(perm, perm + num_rows, resource);
+  for (long i = 0; i < num_rows; ++i) perm[i] = rows[sorted[i].second];
+
+  // Sort the rows that tie on this column by the next one
+  if constexpr (Col + 1 < std::tuple_size_v<Columns>) {
+    std::pmr::vector<std::pair<long, long>> ties(resource);
+    for (long run_start = 0, run_end; run_start < num_rows;
+         run_start = run_end) {
+      run_end = run_start + 1;
+      while (run_end < num_rows &&
+             !comp(sorted[run_start].first, sorted[run_end].first)) {
+        ++run_end;
+      }
+      if (run_end - run_start > 1) ties.emplace_back(run_start, run_end);
+    }
+    learned_sort::utils::parallel_for(ties.size(), num_threads, [&](long t) {
+      sort_rows_by_column<Order, Col + 1>(columns, perm + ties[t].first,
+                                          ties[t].second - ties[t].first, 1,
+                                          resource);
+    });
+  }
+}
+
+/**
+ * @brief Returns the permutation that sorts the rows of a table in
+ * lexicographic order of their keys, i.e., by the keys in [begin, end), then
+ * by the keys in the column at tie_begins[0], and so on. The columns must have
+ * the same number of keys, and are not modified.
+ *
+ * The first column is partitioned with a CDF model, and the buckets are
+ * sorted on multiple threads. Each later column is only used for the groups of
+ * rows that tie on all the columns before it, which are sorted the same way,
+ * with a model of their own if they are large. The rows that tie on all the
+ * columns keep their order in the input.
+ *
+ * The models and the auxiliary buffers are allocated from the resource that
+ * is set with utils::set_scratch_resource(), which must be thread-safe. The
+ * returned permutation is allocated from the heap.
+ *
+ * @tparam Order The direction in which the keys of every column are sorted
+ * @return The offsets of the rows in the sorted order
+ */
+template <order Order = order::ascending, class RandomIt, class... TieIts>
+std::vector<long> sort_permutation(RandomIt begin, RandomIt end,
+                                   TieIts... tie_begins) {
+  const long num_rows = std::distance(begin, end);
+  std::vector<long> perm(num_rows);
+  std::iota(perm.begin(), perm.end(), 0L);
+  if (num_rows > 1) {
+    sort_rows_by_column<Order, 0>(
+        std::make_tuple(begin, tie_begins...), perm.data(), num_rows,
+        learned_sort::utils::default_num_threads(),
+        learned_sort::utils::scratch_resource());
+  }
+  return perm;
+}
+
+/**
+ * @brief Sorts the rows of a table in lexicographic order of their keys (see
+ * sort_permutation()), and permutes each of the columns in place. Columns that
+ * only need to follow the rows, without being sort keys, can be permuted with
+ * the result of sort_permutation() instead. Each column is permuted through a
+ * buffer from the resource that is set with utils::set_scratch_resource(),
+ * while the permutation is kept on the heap.
+ *
+ * @tparam Order The direction in which the keys of every column are sorted
+ */
+template <order Order = order::ascending, class RandomIt, class... TieIts>
+void sort_columns(RandomIt begin, RandomIt end, TieIts... tie_begins) {
+  const std::vector<long> perm =
+      sort_permutation<Order>(begin, end, tie_begins...);
+
+  // Permute the columns one at a time through a buffer
+  auto permute = [&](auto column) {
+    typedef typename std::iterator_traits<decltype(column)>::value_type V;
+    std::pmr::vector<V> permuted(perm.size(),
+                                 learned_sort::utils::scratch_resource());
+    for (size_t i = 0; i < perm.size(); ++i) permuted[i] = column[perm[i]];
+    std::copy(permuted.begin(), permuted.end(), column);
+  };
+  permute(begin);
+  (permute(tie_begins), ...);
+}
+
+}  // namespace learned_sort
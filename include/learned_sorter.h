@@ -0,0 +1,190 @@
+#pragma once
+
+/**
+ * @file learned_sorter.h
+ * @brief A streaming interface to Learned Sort, which turns an unbounded
+ * sequence of input chunks into sorted runs of a fixed size.
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo <anikristo@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+#include "learned_sort.h"
+#include "rmi.h"
+#include "utils.h"
+
+using namespace std;
+
+namespace learned_sort {
+
+/**
+ * @brief Sorts a stream of keys that arrives in chunks, and emits it as a
+ * sequence of sorted runs of `run_sz` keys each (the last run may be shorter).
+ *
+ * The CDF model is trained once on the first chunk(s), until at least
+ * `training_sz` keys have been received. From then on, every key that is
+ * pushed is routed straight into its predicted bucket, so the partitioning
+ * overlaps with the arrival of the input. When a run is complete, the buckets
+ * are sorted and emitted in key order.
+ */
+template <class T>
+class LearnedSorter {
+ public:
+  // Receives each sorted run. The run may be moved out of by the callback.
+  typedef std::function<void(vector<T> &)> RunCallback;
+
+  // The default number of keys to accumulate before training the model
+  static constexpr long DEFAULT_TRAINING_SZ = 1'000'000;
+
+  /**
+   * @brief Constructs a streaming sorter.
+   *
+   * @param run_sz The number of keys in each emitted run.
+   * @param emit The callback that receives the sorted runs in order.
+   * @param params The hyperparameters for the CDF model.
+   * @param training_sz The number of keys to train the CDF model on. The
+   * model is trained on fewer keys if a run completes earlier.
+   */
+  LearnedSorter(long run_sz, RunCallback emit,
+                typename TwoLayerRMI<T>::Params params =
+                    typename TwoLayerRMI<T>::Params(),
+                long training_sz = DEFAULT_TRAINING_SZ)
+      : rmi(params), buckets(PRIMARY_FANOUT) {
+    this->run_sz = std::max(1L, run_sz);
+    this->emit = emit;
+    this->training_sz = std::min(std::max(1L, training_sz), this->run_sz);
+    this->num_buffered = 0;
+    this->model_ready = false;
+    this->use_model = false;
+  }
+
+  /**
+   * @brief Adds a chunk of keys in [begin, end) to the stream. Emits as many
+   * sorted runs as the keys received so far complete.
+   */
+  template <class InputIt>
+  void push(InputIt begin, InputIt end) {
+    if (!model_ready) {
+      // Accumulate the keys until there are enough of them to train on
+      pending.insert(pending.end(), begin, end);
+      if (static_cast<long>(pending.size()) >= training_sz) {
+        prepare_model();
+      }
+    } else {
+      for (auto it = begin; it != end; ++it) {
+        route(*it);
+      }
+    }
+  }
+
+  // Adds a chunk of keys to the stream
+  void push(const vector<T> &chunk) { push(chunk.begin(), chunk.end()); }
+
+  /**
+   * @brief Signals the end of the stream, and emits the keys that remain
+   * buffered as a final, possibly shorter, run.
+   */
+  void finish() {
+    if (!model_ready) {
+      prepare_model();
+    }
+    if (num_buffered > 0) {
+      emit_run();
+    }
+  }
+
+  // Returns whether the keys are being routed through a trained CDF model
+  bool is_model_trained() const { return use_model; }
+
+ private:
+  // Trains the CDF model on the pending keys, and routes them to the buckets
+  void prepare_model() {
+    // The model can only be trained on inputs that Learned Sort would not
+    // delegate to std::sort
+    const long min_sz = std::max<long>(rmi.hp.fanout * rmi.hp.threshold,
+                                       5 * rmi.hp.num_leaf_models);
+    if (static_cast<long>(pending.size()) > min_sz) {
+      use_model = rmi.train(pending.begin(), pending.end());
+    }
+    model_ready = true;
+
+    // Route the keys that arrived before the model was trained
+    for (const auto &key : pending) {
+      route(key);
+    }
+    vector<T>().swap(pending);
+  }
+
+  // Places a key in the bucket that the CDF model predicts for it
+  inline void route(const T &key) {
+    long bucket_idx = 0;
+    if (use_model) {
+      bucket_idx = static_cast<long>(
+          std::max(0., std::min(PRIMARY_FANOUT - 1.,
+                                rmi.predict(key) * PRIMARY_FANOUT)));
+    }
+    buckets[bucket_idx].push_back(key);
+
+    if (++num_buffered == run_sz) {
+      emit_run();
+    }
+  }
+
+  // Sorts the buffered keys bucket by bucket, and emits them as a run
+  void emit_run() {
+    run.clear();
+    run.reserve(num_buffered);
+
+    // Sort each bucket and append it to the run, in key order
+    for (auto &bucket : buckets) {
+      if (bucket.empty()) continue;
+      std::sort(bucket.begin(), bucket.end());
+      run.insert(run.end(), bucket.begin(), bucket.end());
+      bucket.clear();
+    }
+
+    // Touch up the boundaries between buckets, since the model is not
+    // guaranteed to be monotonic
+    learned_sort::utils::insertion_sort(run.begin(), run.end());
+
+    num_buffered = 0;
+    emit(run);
+  }
+
+  // The CDF model used for routing the keys
+  TwoLayerRMI<T> rmi;
+
+  // The keys received before the model was trained
+  vector<T> pending;
+
+  // The keys of the current run, partitioned by their predicted bucket
+  vector<vector<T>> buckets;
+
+  // The run that is being emitted
+  vector<T> run;
+
+  RunCallback emit;
+  long run_sz;
+  long training_sz;
+  long num_buffered;
+  bool model_ready;
+  bool use_model;
+};
+
+}  // namespace learned_sort
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <memory_resource>
 #include <vector>
 
+#include "utils.h"
+
 using namespace std;
 
 namespace learned_sort {
@@ -14,14 +19,19 @@ struct training_point {
   double y;
 };
 
-// Represents linear models
-struct linear_model {
-  double slope = 0;
-  double intercept = 0;
+// Represents linear models, whose weights are stored in precision P. The
+// weights are interleaved and aligned, so that a model never straddles two
+// cache lines.
+template <typename P = double>
+struct alignas(2 * sizeof(P)) linear_model {
+  P slope = 0;
+  P intercept = 0;
 };
 
-// An implementation of a 2-layer RMI model
-template <class T>
+// An implementation of a 2-layer RMI model, which performs inference in
+// precision P (i.e., double or float). The model, its training, and the sorts
+// that use it allocate their memory from the model's memory resource.
+template <class T, class P = double>
 class TwoLayerRMI {
  public:
   // CDF model hyperparameters
@@ -39,6 +49,10 @@ class TwoLayerRMI {
     static constexpr long DEFAULT_NUM_LEAF_MODELS = 1000;
     static constexpr long MIN_SORTING_SIZE = 1e4;
 
+    // The relative deviation of the share of the keys of a leaf model from the
+    // span of the CDF that it predicts, beyond which it is refit (see refit())
+    static constexpr double MAX_BUCKET_FILL_DEVIATION = .5;
+
     // Default constructor
     Params() {
       this->fanout = DEFAULT_FANOUT;
@@ -58,28 +72,109 @@ class TwoLayerRMI {
   };
 
   // Member variables of the CDF model
+  std::pmr::memory_resource *resource;
   bool trained;
-  linear_model root_model;
-  vector<linear_model> leaf_models;
-  vector<T> training_sample;
+  linear_model<P> root_model;
+  std::pmr::vector<linear_model<P>> leaf_models;
   Params hp;
   bool enable_dups_detection;
 
+  // The number of keys in each of the primary buckets of the last sort that
+  // used the model, in ascending order of the CDF
+  std::pmr::vector<long> bucket_fill;
+
   // CDF model constructor
-  TwoLayerRMI(Params p) {
+  TwoLayerRMI(Params p, std::pmr::memory_resource *resource =
+                            learned_sort::utils::scratch_resource())
+      : resource(resource), leaf_models(resource), bucket_fill(resource) {
     this->trained = false;
     this->hp = p;
     this->leaf_models.resize(p.num_leaf_models);
     this->enable_dups_detection = true;
   }
 
+  // Converts a CDF model that was trained in a different precision
+  template <class Q>
+  explicit TwoLayerRMI(const TwoLayerRMI<T, Q> &other)
+      : resource(other.resource),
+        leaf_models(other.resource),
+        bucket_fill(other.bucket_fill, other.resource) {
+    this->trained = other.trained;
+    this->hp.fanout = other.hp.fanout;
+    this->hp.sampling_rate = other.hp.sampling_rate;
+    this->hp.threshold = other.hp.threshold;
+    this->hp.num_leaf_models = other.hp.num_leaf_models;
+    this->enable_dups_detection = other.enable_dups_detection;
+
+    this->root_model.slope = other.root_model.slope;
+    this->root_model.intercept = other.root_model.intercept;
+    this->leaf_models.resize(other.leaf_models.size());
+    for (size_t i = 0; i < other.leaf_models.size(); ++i) {
+      this->leaf_models[i].slope = other.leaf_models[i].slope;
+      this->leaf_models[i].intercept = other.leaf_models[i].intercept;
+    }
+  }
+
+  // Predicts the id of the leaf model that is responsible for a key
+  inline long leaf_index(T key) const {
+    return static_cast<long>(std::max<P>(
+        0, std::min<P>(hp.num_leaf_models - 1,
+                       root_model.slope * key + root_model.intercept)));
+  }
+
+  // Predicts the CDF of a key by traversing both layers of the model
+  inline P predict(T key) const {
+    // Predict the model id in the leaf layer of the RMI
+    long leaf_idx = leaf_index(key);
+
+    // Predict the CDF
+    return leaf_models[leaf_idx].slope * key + leaf_models[leaf_idx].intercept;
+  }
+
+  /**
+   * @brief Measures the error bound of performing inference in precision Q
+   * instead of P, as the largest absolute difference between the CDFs that
+   * the two precisions predict over a strided sample of the keys in [begin,
+   * end). The rounding of the keys themselves to Q is accounted for.
+   *
+   * @param begin Random-access iterators to the initial position of the
+   * sequence of keys to evaluate the model on.
+   * @param end Random-access iterators to the last position of the sequence of
+   * keys to evaluate the model on.
+   * @return The maximum absolute CDF difference between the two precisions.
+   */
+  template <class Q, class RandomIt>
+  double precision_error(RandomIt begin, RandomIt end) const {
+    // Determine the input size
+    const long INPUT_SZ = std::distance(begin, end);
+    if (INPUT_SZ <= 0) return 0;
+
+    // Convert the model to the other precision
+    TwoLayerRMI<T, Q> other(*this);
+
+    // Evaluate both models on roughly as many keys as the minimum sample size
+    const long offset = std::max<long>(
+        1, INPUT_SZ / TwoLayerRMI<T>::Params::MIN_SORTING_SIZE);
+    double max_err = 0;
+    for (auto i = begin; i < end; i += offset) {
+      double err = std::abs(static_cast<double>(this->predict(*i)) -
+                            static_cast<double>(other.predict(*i)));
+      max_err = std::max(max_err, err);
+      if (std::distance(i, end) <= offset) break;
+    }
+
+    return max_err;
+  }
+
   // Pretty-printing function
   void print() {
-    printf("[0][0]: slope=%0.5f; intercept=%0.5f;\n", root_model.slope,
-           root_model.intercept);
+    printf("[0][0]: slope=%0.5f; intercept=%0.5f;\n",
+           static_cast<double>(root_model.slope),
+           static_cast<double>(root_model.intercept));
     for (int model_idx = 0; model_idx < hp.num_leaf_models; ++model_idx) {
       printf("[%i][1]: slope=%0.5f; intercept=%0.5f;\n", model_idx,
-             leaf_models[model_idx].slope, leaf_models[model_idx].intercept);
+             static_cast<double>(leaf_models[model_idx].slope),
+             static_cast<double>(leaf_models[model_idx].intercept));
     }
     cout << "-----------------------------" << endl;
   }
@@ -98,7 +193,8 @@ class TwoLayerRMI {
    * not the element pointed by last.
    * @return true if the model was trained successfully, false otherwise.
    */
-  bool train(vector<T>::iterator begin, vector<T>::iterator end) {
+  template <class RandomIt>
+  bool train(RandomIt begin, RandomIt end) {
     // Determine input size
     const long INPUT_SZ = std::distance(begin, end);
 
@@ -122,12 +218,8 @@ class TwoLayerRMI {
            << TwoLayerRMI<T>::Params::DEFAULT_THRESHOLD << ")." << endl;
     }
 
-    // Initialize the CDF model
-    static const long NUM_LAYERS = 2;
-    vector<vector<vector<training_point<T>>>> training_data(NUM_LAYERS);
-    for (long layer_idx = 0; layer_idx < NUM_LAYERS; ++layer_idx) {
-      training_data[layer_idx].resize(hp.num_leaf_models);
-    }
+    // The bucket fill of a previous model does not describe this one
+    this->bucket_fill.clear();
 
     //----------------------------------------------------------//
     //                           SAMPLE                         //
@@ -138,30 +230,33 @@ class TwoLayerRMI {
         INPUT_SZ, std::max<long>(this->hp.sampling_rate * INPUT_SZ,
                                  TwoLayerRMI<T>::Params::MIN_SORTING_SIZE));
 
-    // Create a sample array
-    this->training_sample.reserve(SAMPLE_SZ);
+    // Create a sample array, which is released when the training finishes
+    std::pmr::vector<T> sample(resource);
+    sample.reserve(SAMPLE_SZ + 1);
 
     // Start sampling
     long offset = static_cast<long>(1. * INPUT_SZ / SAMPLE_SZ);
     for (auto i = begin; i < end; i += offset) {
-      // NOTE:  We don't directly assign SAMPLE_SZ to this->training_sample_sz
-      //        to avoid issues with divisibility
-      this->training_sample.push_back(*i);
+      // NOTE:  We don't directly assign SAMPLE_SZ to the sample size to avoid
+      //        issues with divisibility
+      sample.push_back(*i);
+      if (std::distance(i, end) <= offset) break;
     }
 
     // Sort the sample using the provided comparison function
-    std::sort(this->training_sample.begin(), this->training_sample.end());
+    std::sort(sample.begin(), sample.end());
 
     // Count the number of unique keys
-    auto sample_cpy = this->training_sample;
-    long num_unique_elms = std::distance(
-        sample_cpy.begin(), std::unique(sample_cpy.begin(), sample_cpy.end()));
+    long num_unique_elms = !sample.empty();
+    for (size_t i = 1; i < sample.size(); ++i) {
+      num_unique_elms += sample[i] != sample[i - 1];
+    }
 
     // Stop early if the array has very few unique values. We need at least 2
     // unique training examples per leaf model.
     if (num_unique_elms < 2 * this->hp.num_leaf_models) {
       return false;
-    } else if (num_unique_elms > .9 * training_sample.size()) {
+    } else if (num_unique_elms > .9 * sample.size()) {
       this->enable_dups_detection = false;
     }
 
@@ -169,19 +264,18 @@ class TwoLayerRMI {
     //                     TRAIN THE MODELS                     //
     //----------------------------------------------------------//
 
-    // Populate the training data for the root model
-    for (long i = 0; i < SAMPLE_SZ; ++i) {
-      training_data[0][0].push_back(
-          {this->training_sample[i], 1. * i / SAMPLE_SZ});
-    }
+    // The training data for the root model are the first SAMPLE_SZ keys of
+    // the sample, with their scaled CDF values
+    auto training_point_at = [&](long i) -> training_point<T> {
+      return {sample[i], 1. * i / SAMPLE_SZ};
+    };
 
     // Train the root model using linear interpolation
-    auto *current_training_data = &training_data[0][0];
-    linear_model *current_model = &(this->root_model);
+    linear_model<P> *current_model = &(this->root_model);
 
     // Find the min and max values in the training set
-    training_point<T> min = current_training_data->front();
-    training_point<T> max = current_training_data->back();
+    training_point<T> min = training_point_at(0);
+    training_point<T> max = training_point_at(SAMPLE_SZ - 1);
 
     // Calculate the slope and intercept terms, assuming min.y = 0 and max.y
     current_model->slope = 1. / (max.x - min.x);
@@ -191,53 +285,67 @@ class TwoLayerRMI {
     current_model->slope *= this->hp.num_leaf_models - 1;
     current_model->intercept *= this->hp.num_leaf_models - 1;
 
-    // Populate the training data for the next layer
-    for (const auto &d : *current_training_data) {
-      // Predict the model index in next layer
-      long rank = current_model->slope * d.x + current_model->intercept;
+    // Predicts the model index in the next layer for a training key
+    auto leaf_of = [&](const T &x) {
+      long rank = this->root_model.slope * x + this->root_model.intercept;
 
       // Normalize the rank between 0 and the number of models in the next layer
-      rank = std::max(static_cast<long>(0),
+      return std::max(static_cast<long>(0),
                       std::min(this->hp.num_leaf_models - 1, rank));
+    };
 
-      // Place the data in the predicted training bucket
-      training_data[1][rank].push_back(d);
-    }
+    // Since the root model is monotonic and the sample is sorted, the training
+    // data of each leaf model is a contiguous range of the sample, that starts
+    // where the range of the previous leaf model ends. Hence, the leaf models
+    // are trained in order, scanning the sample once for the split points.
+    long leaf_end = 0;
+    long next_leaf = SAMPLE_SZ > 0 ? leaf_of(sample[0]) : 0;
+
+    // The last training point of the previous leaf model, which can be a
+    // fictive training point if that model was empty
+    training_point<T> prev_back{};
 
     // Train the leaf models
     for (long model_idx = 0; model_idx < this->hp.num_leaf_models;
          ++model_idx) {
+      // Find the range of training points for the current model
+      const long leaf_begin = leaf_end;
+      while (leaf_end < SAMPLE_SZ && next_leaf == model_idx) {
+        ++leaf_end;
+        if (leaf_end < SAMPLE_SZ) next_leaf = leaf_of(sample[leaf_end]);
+      }
+      const long leaf_sz = leaf_end - leaf_begin;
+
       // Update iterator variables
-      current_training_data = &training_data[1][model_idx];
       current_model = &(this->leaf_models[model_idx]);
+      training_point<T> back =
+          leaf_sz > 0 ? training_point_at(leaf_end - 1) : prev_back;
 
       // Interpolate the min points in the training buckets
       if (model_idx == 0) {
         // The current model is the first model in the current layer
 
-        if (current_training_data->size() < 2) {
+        if (leaf_sz < 2) {
           // Case 1: The first model in this layer is empty
           current_model->slope = 0;
           current_model->intercept = 0;
 
-          // Insert a fictive training point to avoid propagating more than one
+          // Use a fictive training point to avoid propagating more than one
           // empty initial models.
-          training_point<T> tp;
-          tp.x = 0;
-          tp.y = 0;
-          current_training_data->push_back(tp);
+          back.x = 0;
+          back.y = 0;
         } else {
           // Case 2: The first model in this layer is not empty
 
-          min = current_training_data->front();
-          max = current_training_data->back();
+          min = training_point_at(leaf_begin);
+          max = back;
 
           // Hallucinating as if min.y = 0
           current_model->slope = (1. * max.y) / (max.x - min.x);
           current_model->intercept = min.y - current_model->slope * min.x;
         }
       } else if (model_idx == this->hp.num_leaf_models - 1) {
-        if (current_training_data->empty()) {
+        if (leaf_sz == 0) {
           // Case 3: The final model in this layer is empty
 
           current_model->slope = 0;
@@ -245,8 +353,8 @@ class TwoLayerRMI {
         } else {
           // Case 4: The last model in this layer is not empty
 
-          min = training_data[1][model_idx - 1].back();
-          max = current_training_data->back();
+          min = prev_back;
+          max = back;
 
           // Hallucinating as if max.y = 1
           current_model->slope = (1. - min.y) / (max.x - min.x);
@@ -255,34 +363,31 @@ class TwoLayerRMI {
       } else {
         // The current model is not the first model in the current layer
 
-        if (current_training_data->empty()) {
+        if (leaf_sz == 0) {
           // Case 5: The intermediate model in this layer is empty
           current_model->slope = 0;
-          current_model->intercept = training_data[1][model_idx - 1]
-                                         .back()
-                                         .y;  // If the previous model
-                                              // was empty too, it will
-                                              // use the fictive
-                                              // training points
-
-          // Insert a fictive training point to avoid propagating more than one
-          // empty initial models.
+          current_model->intercept = prev_back.y;  // If the previous model
+                                                   // was empty too, it will
+                                                   // use the fictive
+                                                   // training points
+
+          // The fictive training point of this model is the last training point
+          // of the previous one, to avoid propagating more than one empty
+          // initial models.
           // NOTE: This will _NOT_ throw to DIV/0 due to identical x's and y's
           // because it is working backwards.
-          training_point<T> tp;
-          tp.x = training_data[1][model_idx - 1].back().x;
-          tp.y = training_data[1][model_idx - 1].back().y;
-          current_training_data->push_back(tp);
         } else {
           // Case 6: The intermediate leaf model is not empty
 
-          min = training_data[1][model_idx - 1].back();
-          max = current_training_data->back();
+          min = prev_back;
+          max = back;
 
           current_model->slope = (max.y - min.y) / (max.x - min.x);
           current_model->intercept = min.y - current_model->slope * min.x;
         }
       }
+
+      prev_back = back;
     }
 
     // NOTE:
@@ -299,5 +404,135 @@ class TwoLayerRMI {
 
     return true;
   }
+
+  /**
+   * @brief Refits the leaf models whose share of the keys deviates from the
+   * span of the CDF that they predict by more than MAX_BUCKET_FILL_DEVIATION,
+   * e.g., for re-sorting keys that changed only in a few key ranges since the
+   * model was trained.
+   *
+   * The keys are sampled at the sampling rate, but the sample is not sorted:
+   * since the leaf models interpolate between the last training points of
+   * consecutive leaves, it suffices to count the sampled keys of each leaf,
+   * and find its largest one. A leaf model fills the buckets of the CDF span
+   * that it predicts between these points with its share of the keys, so the
+   * leaves whose share deviates from their span are interpolated between the
+   * new points. Since a change in the number of keys of one leaf shifts the
+   * CDF of all the keys after it, the other leaf models are scaled in runs of
+   * consecutive leaves to the new CDF values at the ends of each run, which
+   * keeps their fit relative to each other.
+   *
+   * @param begin Random-access iterators to the initial position of the
+   * sequence of keys to refit the model on.
+   * @param end Random-access iterators to the last position of the sequence of
+   * keys to refit the model on.
+   * @return The number of refit leaf models, which is 0 if the model is not
+   * trained.
+   */
+  template <class RandomIt>
+  long refit(RandomIt begin, RandomIt end) {
+    const long INPUT_SZ = std::distance(begin, end);
+    if (!this->trained || INPUT_SZ == 0) return 0;
+
+    // Count the sampled keys of each leaf, and find the largest one
+    const long num_leaf_models = this->hp.num_leaf_models;
+    std::pmr::vector<long> leaf_sizes(num_leaf_models, 0, resource);
+    std::pmr::vector<T> leaf_maxs(num_leaf_models, resource);
+    const long SAMPLE_SZ = std::min<long>(
+        INPUT_SZ, std::max<long>(this->hp.sampling_rate * INPUT_SZ,
+                                 TwoLayerRMI<T>::Params::MIN_SORTING_SIZE));
+    const long offset = std::max(1L, INPUT_SZ / SAMPLE_SZ);
+    long num_sampled = 0;
+    T min_key{};
+    for (long i = 0; i < INPUT_SZ; i += offset, ++num_sampled) {
+      const T key = begin[i];
+      const long leaf_idx = leaf_index(key);
+      if (leaf_sizes[leaf_idx]++ == 0 || leaf_maxs[leaf_idx] < key) {
+        leaf_maxs[leaf_idx] = key;
+      }
+      if (num_sampled == 0 || key < min_key) min_key = key;
+    }
+
+    // The last training point of each leaf is its largest key, at the CDF of
+    // the keys up to it. Empty leaves repeat the point of the previous leaf,
+    // and the first leaf starts at the smallest key.
+    std::pmr::vector<training_point<T>> backs(num_leaf_models, resource);
+    training_point<T> prev_back{min_key, 0};
+    long cum_size = 0;
+    for (long model_idx = 0; model_idx < num_leaf_models; ++model_idx) {
+      if (leaf_sizes[model_idx] > 0) {
+        cum_size += leaf_sizes[model_idx];
+        prev_back = {leaf_maxs[model_idx], 1. * cum_size / num_sampled};
+      }
+      backs[model_idx] = prev_back;
+    }
+    auto front_of = [&](long model_idx) {
+      return model_idx == 0 ? training_point<T>{min_key, 0}
+                            : backs[model_idx - 1];
+    };
+
+    // Flag the leaves whose share of the sampled keys deviates from the span
+    // of the CDF that they predict over the range of these keys, since they
+    // fill the buckets of that span accordingly. Deviations of less than a
+    // bucket's share are within the sampling noise of the sparse leaves, and
+    // they do not overfill any bucket.
+    std::pmr::vector<bool> refit_leaf(num_leaf_models, false, resource);
+    for (long model_idx = 0; model_idx < num_leaf_models; ++model_idx) {
+      const linear_model<P> &model = this->leaf_models[model_idx];
+      auto predict_cdf = [&](T key) {
+        return std::max(0., std::min(1., 1. * model.slope * key +
+                                             model.intercept));
+      };
+      const double span = predict_cdf(backs[model_idx].x) -
+                          predict_cdf(front_of(model_idx).x);
+      const double share = 1. * leaf_sizes[model_idx] / num_sampled;
+      refit_leaf[model_idx] =
+          std::abs(share - span) >
+          TwoLayerRMI<T>::Params::MAX_BUCKET_FILL_DEVIATION *
+              std::max(span, 1. / this->hp.fanout);
+    }
+
+    // Go over the runs of consecutive leaves that are either all refit or all
+    // kept
+    long num_refit = 0;
+    for (long run_begin = 0, run_end; run_begin < num_leaf_models;
+         run_begin = run_end) {
+      run_end = run_begin + 1;
+      while (run_end < num_leaf_models &&
+             refit_leaf[run_end] == refit_leaf[run_begin]) {
+        ++run_end;
+      }
+
+      // The kept leaf models are scaled, so that they predict the new CDF at
+      // both ends of the run, which keeps the model continuous
+      const training_point<T> front = front_of(run_begin);
+      const training_point<T> back = backs[run_end - 1];
+      const linear_model<P> &first = this->leaf_models[run_begin];
+      const linear_model<P> &last = this->leaf_models[run_end - 1];
+      const double old_front = first.slope * front.x + first.intercept;
+      const double old_back = last.slope * back.x + last.intercept;
+      if (!refit_leaf[run_begin] && old_back > old_front) {
+        const double scale = (back.y - front.y) / (old_back - old_front);
+        for (long model_idx = run_begin; model_idx < run_end; ++model_idx) {
+          linear_model<P> &model = this->leaf_models[model_idx];
+          model.intercept = front.y + (model.intercept - old_front) * scale;
+          model.slope *= scale;
+        }
+        continue;
+      }
+
+      // The refit leaf models interpolate between their training points
+      for (long model_idx = run_begin; model_idx < run_end; ++model_idx) {
+        const training_point<T> min = front_of(model_idx);
+        const training_point<T> max = backs[model_idx];
+        linear_model<P> &model = this->leaf_models[model_idx];
+        model.slope = max.x > min.x ? (max.y - min.y) / (max.x - min.x) : 0;
+        model.intercept = max.y - model.slope * max.x;
+        ++num_refit;
+      }
+    }
+
+    return num_refit;
+  }
 };
 }  // namespace learned_sort
\ No newline at end of file
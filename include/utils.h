@@ -1,5 +1,28 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 namespace learned_sort {
 namespace utils {
 
@@ -9,10 +32,426 @@ inline T _get_key(T a) {
   return a;
 }
 
-template <class RandomIt>
-void insertion_sort(RandomIt begin, RandomIt end) {
+// The unsigned integer type with the same size as the floating-point type T
+template <class T>
+using flipped_t =
+    std::conditional_t<sizeof(T) == sizeof(uint32_t), uint32_t, uint64_t>;
+
+/**
+ * @brief Maps a floating-point key to an unsigned integer, such that the
+ * integers are ordered as the keys in the IEEE 754 total order: -NaN < -inf <
+ * ... < -0.0 < +0.0 < ... < +inf < +NaN. The sign bit of positive keys is
+ * flipped, and all the bits of negative keys are flipped.
+ */
+template <class T>
+inline flipped_t<T> float_flip(T key) {
+  static_assert(std::is_floating_point_v<T> &&
+                sizeof(T) == sizeof(flipped_t<T>));
+  constexpr int SIGN_SHIFT = 8 * sizeof(T) - 1;
+  constexpr flipped_t<T> SIGN_MASK = flipped_t<T>(1) << SIGN_SHIFT;
+
+  const auto bits = std::bit_cast<flipped_t<T>>(key);
+  return bits ^ (-(bits >> SIGN_SHIFT) | SIGN_MASK);
+}
+
+// Maps an unsigned integer produced by float_flip() back to its key
+template <class T>
+inline T float_unflip(flipped_t<T> bits) {
+  constexpr int SIGN_SHIFT = 8 * sizeof(T) - 1;
+  constexpr flipped_t<T> SIGN_MASK = flipped_t<T>(1) << SIGN_SHIFT;
+
+  return std::bit_cast<T>(bits ^ (((bits >> SIGN_SHIFT) - 1) | SIGN_MASK));
+}
+
+/**
+ * @brief Copies the elements in [first, last) to the range beginning at
+ * d_first using non-temporal stores, which bypass the cache, whenever the
+ * destination is contiguous memory aligned to 16 bytes. Otherwise falls back
+ * to std::copy. Call stream_fence() before reading back the destination.
+ */
+template <class T, class RandomIt>
+void stream_copy(const T *first, const T *last, RandomIt d_first) {
+#ifdef __SSE2__
+  if constexpr (std::contiguous_iterator<RandomIt> &&
+                std::is_trivially_copyable_v<T>) {
+    const size_t num_bytes = (last - first) * sizeof(T);
+    char *dst = reinterpret_cast<char *>(std::to_address(d_first));
+    const char *src = reinterpret_cast<const char *>(first);
+
+    if (reinterpret_cast<uintptr_t>(dst) % sizeof(__m128i) == 0) {
+      // Stream the 16-byte blocks
+      size_t off = 0;
+      for (; off + sizeof(__m128i) <= num_bytes; off += sizeof(__m128i)) {
+        _mm_stream_si128(
+            reinterpret_cast<__m128i *>(dst + off),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + off)));
+      }
+
+      // Copy the remaining bytes
+      std::copy(src + off, src + num_bytes, dst + off);
+      return;
+    }
+  }
+#endif
+  std::copy(first, last, d_first);
+}
+
+// Orders the non-temporal stores issued by stream_copy before later accesses
+inline void stream_fence() {
+#ifdef __SSE2__
+  _mm_sfence();
+#endif
+}
+
+/**
+ * @brief A memory resource that backs large allocations with 2 MB huge pages,
+ * to reduce the TLB misses when they are accessed in a scattered way.
+ *
+ * Allocations of at least `min_alloc_sz` bytes are mapped with mmap, either
+ * from the explicit huge page pool (MAP_HUGETLB), or as regular pages aligned
+ * to 2 MB that are marked with madvise(MADV_HUGEPAGE) for transparent huge
+ * pages. Smaller allocations, and the ones that cannot be mapped (e.g., when
+ * the huge page pool is empty, or on other platforms), are served by the
+ * upstream resource. This resource is thread-safe if its upstream is.
+ */
+class huge_page_resource : public std::pmr::memory_resource {
+ public:
+  static constexpr size_t HUGE_PAGE_SZ = 2 << 20;
+
+  /**
+   * @param explicit_huge_pages Whether to map the allocations from the explicit
+   * huge page pool, before trying transparent huge pages
+   * @param min_alloc_sz The size of the smallest allocation that is mapped to
+   * huge pages
+   * @param upstream The resource for the allocations that are not mapped
+   */
+  explicit huge_page_resource(
+      bool explicit_huge_pages = false, size_t min_alloc_sz = HUGE_PAGE_SZ / 8,
+      std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+      : explicit_huge_pages(explicit_huge_pages),
+        min_alloc_sz(min_alloc_sz),
+        upstream(upstream) {}
+
+ protected:
+  void *do_allocate(size_t bytes, size_t alignment) override {
+#ifdef __linux__
+    if (bytes >= min_alloc_sz && alignment <= HUGE_PAGE_SZ) {
+      void *p = map(mapped_size(bytes));
+      if (p != nullptr) {
+        std::lock_guard<std::mutex> lock(mapped_mutex);
+        mapped.insert(p);
+        return p;
+      }
+    }
+#endif
+    return upstream->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+#ifdef __linux__
+    {
+      std::lock_guard<std::mutex> lock(mapped_mutex);
+      if (mapped.erase(p)) {
+        munmap(p, mapped_size(bytes));
+        return;
+      }
+    }
+#endif
+    upstream->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+
+ private:
+  // Rounds the size of an allocation up to a multiple of the huge page size
+  static size_t mapped_size(size_t bytes) {
+    return (bytes + HUGE_PAGE_SZ - 1) / HUGE_PAGE_SZ * HUGE_PAGE_SZ;
+  }
+
+#ifdef __linux__
+  // Maps `len` bytes aligned to the huge page size, or returns nullptr
+  void *map(size_t len) {
+    constexpr int PROT = PROT_READ | PROT_WRITE;
+    constexpr int FLAGS = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_HUGETLB
+    if (explicit_huge_pages) {
+      void *p = mmap(nullptr, len, PROT, FLAGS | MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED) return p;
+    }
+#endif
+
+    // Over-allocate, so that the mapping can be trimmed to be aligned
+    char *raw = static_cast<char *>(
+        mmap(nullptr, len + HUGE_PAGE_SZ, PROT, FLAGS, -1, 0));
+    if (raw == MAP_FAILED) return nullptr;
+
+    char *aligned = reinterpret_cast<char *>(
+        (reinterpret_cast<uintptr_t>(raw) + HUGE_PAGE_SZ - 1) / HUGE_PAGE_SZ *
+        HUGE_PAGE_SZ);
+    if (aligned > raw) munmap(raw, aligned - raw);
+    munmap(aligned + len, raw + HUGE_PAGE_SZ - aligned);
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, len, MADV_HUGEPAGE);
+#endif
+    return aligned;
+  }
+#endif
+
+  bool explicit_huge_pages;
+  size_t min_alloc_sz;
+  std::pmr::memory_resource *upstream;
+
+  // The allocations that were mapped by this resource
+  std::unordered_set<void *> mapped;
+  std::mutex mapped_mutex;
+};
+
+// Holds the default memory resource for Learned Sort
+inline std::pmr::memory_resource *&scratch_resource_ptr() {
+  static std::pmr::memory_resource *resource = std::pmr::new_delete_resource();
+  return resource;
+}
+
+// Returns the default memory resource for Learned Sort
+inline std::pmr::memory_resource *scratch_resource() {
+  return scratch_resource_ptr();
+}
+
+/**
+ * @brief Sets the default memory resource for the CDF models and the internal
+ * buffers (fragments, swap buffers and counting sort scratch space) of the
+ * sorts that start after this call, and returns the previous one. The
+ * resource must outlive those sorts, and must be thread-safe if they run
+ * concurrently.
+ */
+inline std::pmr::memory_resource *set_scratch_resource(
+    std::pmr::memory_resource *resource) {
+  auto *prev = scratch_resource_ptr();
+  scratch_resource_ptr() = resource;
+  return prev;
+}
+
+// A buffer of default-initialized elements, allocated from a memory resource
+template <class T>
+class scratch_buffer {
+ public:
+  scratch_buffer(size_t sz, std::pmr::memory_resource *resource)
+      : sz(sz),
+        resource(resource),
+        buf(static_cast<T *>(resource->allocate(sz * sizeof(T), alignof(T)))) {
+    std::uninitialized_default_construct_n(buf, sz);
+  }
+
+  ~scratch_buffer() {
+    std::destroy_n(buf, sz);
+    resource->deallocate(buf, sz * sizeof(T), alignof(T));
+  }
+
+  scratch_buffer(const scratch_buffer &) = delete;
+  scratch_buffer &operator=(const scratch_buffer &) = delete;
+
+  inline T *data() const { return buf; }
+
+ private:
+  size_t sz;
+  std::pmr::memory_resource *resource;
+  T *buf;
+};
+
+// Returns the number of threads that the parallel steps run on by default
+inline long default_num_threads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * @brief Calls fn(task_idx) for every task in [0, num_tasks), on up to
+ * `num_threads` threads (including the calling one), which take the tasks in
+ * order as they become idle.
+ */
+template <class Function>
+void parallel_for(long num_tasks, long num_threads, Function fn) {
+  num_threads = std::max(1L, std::min(num_threads, num_tasks));
+
+  std::atomic<long> next_task{0};
+  auto worker = [&]() {
+    for (long task_idx; (task_idx = next_task++) < num_tasks;) {
+      fn(task_idx);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (long i = 1; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+// The number of keys in each of the chunks of an input that are partitioned
+// in parallel by partition_by_bucket()
+static constexpr long PARTITION_CHUNK_SZ = 1 << 18;
+
+/**
+ * @brief Scatters the keys in [begin, end), along with their offsets, to the
+ * buckets given by bucket_of(key), on up to `num_threads` threads.
+ *
+ * The input is split into chunks, whose keys are first counted per bucket, and
+ * then scattered to the slots that the counts reserve for the chunk within
+ * each bucket. The keys of a bucket thus keep the order of the input.
+ *
+ * @param entries The output, which receives the pairs of a key and its offset
+ * @param bucket_offsets The output, which receives the offsets where each of
+ * the `num_buckets` buckets starts in `entries`, followed by the input size
+ */
+template <class RandomIt, class BucketOf>
+void partition_by_bucket(
+    RandomIt begin, RandomIt end, BucketOf bucket_of, long num_buckets,
+    std::pair<typename std::iterator_traits<RandomIt>::value_type, long>
+        *entries,
+    std::pmr::vector<long> &bucket_offsets, long num_threads,
+    std::pmr::memory_resource *resource) {
+  const long input_sz = std::distance(begin, end);
+  const long num_chunks =
+      std::max(1L, (input_sz + PARTITION_CHUNK_SZ - 1) / PARTITION_CHUNK_SZ);
+
+  // Count the keys of every chunk in each bucket
+  std::pmr::vector<long> chunk_offsets(num_chunks * num_buckets, 0, resource);
+  parallel_for(num_chunks, num_threads, [&](long chunk) {
+    long *counts = chunk_offsets.data() + chunk * num_buckets;
+    const long chunk_end = std::min(input_sz, (chunk + 1) * PARTITION_CHUNK_SZ);
+    for (long i = chunk * PARTITION_CHUNK_SZ; i < chunk_end; ++i) {
+      ++counts[bucket_of(begin[i])];
+    }
+  });
+
+  // Turn the counts into the offsets where each chunk writes to each bucket
+  bucket_offsets.assign(num_buckets + 1, 0);
+  long write_off = 0;
+  for (long bucket_idx = 0; bucket_idx < num_buckets; ++bucket_idx) {
+    bucket_offsets[bucket_idx] = write_off;
+    for (long chunk = 0; chunk < num_chunks; ++chunk) {
+      long &offset = chunk_offsets[chunk * num_buckets + bucket_idx];
+      const long count = offset;
+      offset = write_off;
+      write_off += count;
+    }
+  }
+  bucket_offsets[num_buckets] = write_off;
+
+  // Scatter the keys
+  parallel_for(num_chunks, num_threads, [&](long chunk) {
+    long *offsets = chunk_offsets.data() + chunk * num_buckets;
+    const long chunk_end = std::min(input_sz, (chunk + 1) * PARTITION_CHUNK_SZ);
+    for (long i = chunk * PARTITION_CHUNK_SZ; i < chunk_end; ++i) {
+      const auto key = begin[i];
+      entries[offsets[bucket_of(key)]++] = {key, i};
+    }
+  });
+}
+
+/**
+ * @brief Returns the first position in the sorted range [first, last) whose key
+ * is not ordered before `key` w.r.t. `comp`, like std::lower_bound. The search
+ * starts from a predicted position `hint`, and grows exponentially away from
+ * it, so it takes O(log d) comparisons when the prediction is d positions off.
+ */
+template <class RandomIt, class T, class Compare>
+RandomIt exponential_lower_bound(RandomIt first, RandomIt last, RandomIt hint,
+                                 const T &key, Compare comp) {
+  long step = 1;
+  if (hint != last && comp(*hint, key)) {
+    // The bound is after the hint
+    auto lo = hint + 1;
+    while (last - lo > step && comp(lo[step - 1], key)) {
+      lo += step;
+      step *= 2;
+    }
+    return std::lower_bound(lo, lo + std::min<long>(step, last - lo), key,
+                            comp);
+  } else {
+    // The bound is at, or before the hint
+    auto hi = hint;
+    while (hi - first > step && !comp(hi[-step], key)) {
+      hi -= step;
+      step *= 2;
+    }
+    return std::lower_bound(hi - std::min<long>(step, hi - first), hi, key,
+                            comp);
+  }
+}
+
+/**
+ * @brief Merges the sorted ranges [first1, last1) and [first2, last2) into the
+ * range beginning at d_first, like std::merge, and returns the end of the
+ * output. The choice of the next key is made with conditional moves rather
+ * than branches, since they are mispredicted about half the time when the
+ * ranges interleave. The keys are merged from the front and from the back at
+ * the same time, which gives the CPU two independent chains of loads and
+ * comparisons to overlap.
+ */
+template <class RandomIt1, class RandomIt2, class OutputIt, class Compare>
+OutputIt branchless_merge(RandomIt1 first1, RandomIt1 last1, RandomIt2 first2,
+                          RandomIt2 last2, OutputIt d_first, Compare comp) {
+  const long output_sz = (last1 - first1) + (last2 - first2);
+  OutputIt d_last = d_first + output_sz;
+  OutputIt d_back = d_last;
+
+  // Merge in rounds, none of which can consume a range from both ends
+  for (long num_steps = output_sz / 2; num_steps > 0;) {
+    const long round_sz = std::min(
+        num_steps, std::min<long>(last1 - first1, last2 - first2) / 2);
+    if (round_sz == 0) break;
+
+    for (long i = 0; i < round_sz; ++i) {
+      // Take the smallest key at the front
+      const auto front1 = *first1;
+      const auto front2 = *first2;
+      const bool take_front2 = comp(front2, front1);
+      *d_first = take_front2 ? front2 : front1;
+      ++d_first;
+      first1 += !take_front2;
+      first2 += take_front2;
+
+      // Take the largest key at the back
+      const auto back1 = last1[-1];
+      const auto back2 = last2[-1];
+      const bool take_back1 = comp(back2, back1);
+      --d_back;
+      *d_back = take_back1 ? back1 : back2;
+      last1 -= take_back1;
+      last2 -= !take_back1;
+    }
+    num_steps -= round_sz;
+  }
+
+  // Merge the keys that remain in the middle
+  while (first1 != last1 && first2 != last2) {
+    const auto key1 = *first1;
+    const auto key2 = *first2;
+    const bool take2 = comp(key2, key1);
+    *d_first = take2 ? key2 : key1;
+    ++d_first;
+    first1 += !take2;
+    first2 += take2;
+  }
+  d_first = std::copy(first1, last1, d_first);
+  std::copy(first2, last2, d_first);
+  return d_last;
+}
+
+// Sorts [begin, end) with respect to `comp`, which defaults to ascending order
+template <class RandomIt, class Compare = std::less<>>
+void insertion_sort(RandomIt begin, RandomIt end, Compare comp = Compare()) {
   // Determine the data type
-  typedef typename iterator_traits<RandomIt>::value_type T;
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
 
   // Determine the input size
   const size_t input_sz = std::distance(begin, end);
@@ -24,7 +463,7 @@ void insertion_sort(RandomIt begin, RandomIt end) {
   for (auto i = begin + 1; i != end; ++i) {
     key = i[0];
     cmp_idx = i - 1;
-    while (cmp_idx >= begin && cmp_idx[0] > key) {
+    while (cmp_idx >= begin && comp(key, cmp_idx[0])) {
       cmp_idx[1] = cmp_idx[0];
       --cmp_idx;
     }
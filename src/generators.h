@@ -19,211 +19,295 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <numeric>
 #include <random>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
 using namespace std;
 
-template <class T>
-vector<T> exponential_distr(size_t size, double lambda = 2) {
-  // Initialize random engine with normal distribution
-  random_device rd;
-  mt19937 generator(rd());
-  exponential_distribution<> distribution(lambda);
+// The seed that the generators use by default
+constexpr uint64_t DEFAULT_SEED = 0x5eed;
 
-  // Populate the input
+// The number of consecutive keys that are generated from the same random
+// stream. This is fixed, so that the output does not depend on the number of
+// threads that generate it.
+constexpr size_t GENERATOR_BLOCK_SZ = 1 << 16;
+
+// The number of threads that the generators use
+inline size_t &generator_threads() {
+  static size_t num_threads = std::max(1u, thread::hardware_concurrency());
+  return num_threads;
+}
+
+// The SplitMix64 finalizer, which maps a counter to a well-mixed 64-bit value
+inline uint64_t mix64(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * @brief A counter-based random number generator (SplitMix64), whose stream
+ * is fully determined by the seed and the index of the block that it
+ * generates. It can be used with the distributions of <random>.
+ */
+class block_rng {
+ public:
+  typedef uint64_t result_type;
+
+  block_rng(uint64_t seed, uint64_t block_idx)
+      : counter(mix64(seed ^ mix64(block_idx + 0x9e3779b97f4a7c15ULL))) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+
+  inline result_type operator()() {
+    counter += 0x9e3779b97f4a7c15ULL;
+    return mix64(counter);
+  }
+
+ private:
+  uint64_t counter;
+};
+
+/**
+ * @brief Generates `size` keys in parallel, in blocks of GENERATOR_BLOCK_SZ
+ * keys. The function `fill_block(arr, block_begin, block_end, rng)` populates
+ * the positions [block_begin, block_end) of the array, drawing from the
+ * random stream of the block.
+ */
+template <class T, class BlockFn>
+vector<T> generate_blocks(size_t size, uint64_t seed, BlockFn fill_block) {
   vector<T> arr(size);
-  for (size_t i = 0; i < size; i++) {
-    arr[i] = distribution(generator);
+  const size_t num_blocks =
+      (size + GENERATOR_BLOCK_SZ - 1) / GENERATOR_BLOCK_SZ;
+  const size_t num_threads = std::min(generator_threads(), num_blocks);
+
+  // Threads claim the next unprocessed block until there are none left
+  atomic<size_t> next_block(0);
+  auto worker = [&]() {
+    for (size_t block_idx = next_block++; block_idx < num_blocks;
+         block_idx = next_block++) {
+      const size_t block_begin = block_idx * GENERATOR_BLOCK_SZ;
+      const size_t block_end = std::min(block_begin + GENERATOR_BLOCK_SZ, size);
+      block_rng rng(seed, block_idx);
+      fill_block(arr, block_begin, block_end, rng);
+    }
+  };
+
+  if (num_threads <= 1) {
+    worker();
+  } else {
+    vector<thread> threads;
+    for (size_t i = 0; i < num_threads; i++) {
+      threads.emplace_back(worker);
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
   }
 
   return arr;
 }
 
+// Generates `size` keys in parallel by drawing each one from `distribution`
+template <class T, class Distr>
+vector<T> generate_from(size_t size, uint64_t seed, const Distr &distribution,
+                        double scale = 1) {
+  return generate_blocks<T>(
+      size, seed,
+      [&](vector<T> &arr, size_t block_begin, size_t block_end,
+          block_rng &rng) {
+        // Every block starts from a fresh copy of the distribution, so that it
+        // does not depend on the state that the previous blocks left behind
+        Distr distr(distribution);
+        for (size_t i = block_begin; i < block_end; i++) {
+          arr[i] = distr(rng) * scale;
+        }
+      });
+}
+
+// Generates `size` keys in parallel, where the i-th key is `key_fn(i)`
+template <class T, class KeyFn>
+vector<T> generate_indexed(size_t size, KeyFn key_fn) {
+  return generate_blocks<T>(
+      size, 0,
+      [&](vector<T> &arr, size_t block_begin, size_t block_end, block_rng &) {
+        for (size_t i = block_begin; i < block_end; i++) {
+          arr[i] = key_fn(i);
+        }
+      });
+}
+
+template <class T>
+vector<T> exponential_distr(size_t size, double lambda = 2,
+                            uint64_t seed = DEFAULT_SEED) {
+  return generate_from<T>(size, seed, exponential_distribution<>(lambda));
+}
+
 template <class T>
 vector<T> lognormal_distr(size_t size, double mean = 0, double stddev = 0.5,
-                          double scale = 0) {
+                          double scale = 0, uint64_t seed = DEFAULT_SEED) {
   // Adjust the default scale parameter w.r.t. the numerical type
   if (!(is_same<float, T>() || is_same<double, T>()) && scale <= 0)
     scale = size;
   else if (scale <= 0)
     scale = 1;
 
-  // Initialize random engine with normal distribution
-  random_device rd;
-  mt19937 generator(rd());
-  lognormal_distribution<> distribution(mean, stddev);
-
-  // Populate the input
-  vector<T> arr(size);
-  for (size_t i = 0; i < size; i++) {
-    arr[i] = distribution(generator) * scale;
-  }
-
-  return arr;
+  return generate_from<T>(size, seed, lognormal_distribution<>(mean, stddev),
+                          scale);
 }
 
 template <class T>
 vector<T> modulo_distr(size_t size, size_t mod = 16) {
-  // Populate the input
-  vector<T> arr(size);
-  for (size_t i = 0; i < size; i++) {
-    arr[i] = i % mod;
-  }
-
-  return arr;
+  return generate_indexed<T>(size, [=](size_t i) { return i % mod; });
 }
 
 template <class T>
-vector<T> normal_distr(size_t size, double mean = 0, double stddev = 1) {
-  // Initialize random engine with normal distribution
-  random_device rd;
-  mt19937 generator(rd());
-  normal_distribution<> distribution(mean, stddev);
-
-  // Populate the input
-  vector<T> arr(size);
-  for (size_t i = 0; i < size; i++) {
-    arr[i] = distribution(generator);
-  }
-  return arr;
+vector<T> normal_distr(size_t size, double mean = 0, double stddev = 1,
+                       uint64_t seed = DEFAULT_SEED) {
+  return generate_from<T>(size, seed, normal_distribution<>(mean, stddev));
 }
 
 template <class T>
-vector<T> uniform_distr(size_t size, double a = 0, double b = -1) {
+vector<T> uniform_distr(size_t size, double a = 0, double b = -1,
+                        uint64_t seed = DEFAULT_SEED) {
   // Adjust the default parameters
   if (a == 0 && b == -1) {
     b = size;
     if (is_signed<T>::value) a = -1. * size;
   }
 
-  // Initialize random engine with normal distribution
-  random_device rd;
-  mt19937 generator(rd());
-  uniform_real_distribution<> distribution(a, b);
-
-  // Populate the input
-  vector<T> arr(size);
-  for (size_t i = 0; i < size; i++) {
-    arr[i] = distribution(generator);
-  }
-
-  return arr;
+  return generate_from<T>(size, seed, uniform_real_distribution<>(a, b));
 }
 
 template <class T>
-vector<T> mix_of_gauss_distr(size_t size, size_t num_gauss = 5) {
+vector<T> mix_of_gauss_distr(size_t size, size_t num_gauss = 5,
+                             uint64_t seed = DEFAULT_SEED) {
   // Generate the means
-  vector<double> means = uniform_distr<double>(num_gauss, -500, 500);
+  vector<double> means = uniform_distr<double>(num_gauss, -500, 500, seed + 1);
 
   // Generate the stdevs
-  vector<double> stdevs = uniform_distr<double>(num_gauss, 0, 100);
+  vector<double> stdevs = uniform_distr<double>(num_gauss, 0, 100, seed + 2);
 
   // Generate the weights
-  vector<double> weights = uniform_distr<double>(num_gauss, 0, 1);
+  vector<double> weights = uniform_distr<double>(num_gauss, 0, 1, seed + 3);
 
   // Normalize the weights
   double sum_of_weights = std::accumulate(weights.begin(), weights.end(), 0.);
   std::for_each(weights.begin(), weights.end(),
-                [&](auto x) { x /= sum_of_weights; });
-
-  // Initialize random number generator
-  random_device rd;
-  mt19937 generator(rd());
-
-  // Initialize random distribution selector
-  discrete_distribution<int> index_selector(weights.begin(), weights.end());
+                [&](auto &x) { x /= sum_of_weights; });
 
   // Start generating random numbers from normal distributions
-  vector<T> arr(size);
-  for (size_t i = 0; i < size; ++i) {
-    auto random_idx = index_selector(generator);
-    normal_distribution<> distribution(means[random_idx], stdevs[random_idx]);
-
-    auto val = distribution(generator);
-    arr[i] = val;
-  }
-
-  return arr;
+  return generate_blocks<T>(
+      size, seed,
+      [&](vector<T> &arr, size_t block_begin, size_t block_end,
+          block_rng &rng) {
+        // Initialize random distribution selector
+        discrete_distribution<int> index_selector(weights.begin(),
+                                                  weights.end());
+
+        for (size_t i = block_begin; i < block_end; ++i) {
+          auto random_idx = index_selector(rng);
+          normal_distribution<> distribution(means[random_idx],
+                                             stdevs[random_idx]);
+          arr[i] = distribution(rng);
+        }
+      });
 }
 
 template <class T>
-vector<T> chi_squared_distr(size_t size, double k = 4) {
-  // Initialize random number generator
-  random_device rd;
-  mt19937 generator(rd());
-  chi_squared_distribution<> distribution(k);
-
-  // Populate the input
-  vector<T> arr(size);
-  for (size_t i = 0; i < size; ++i) {
-    arr[i] = distribution(generator);
-  }
-
-  return arr;
+vector<T> chi_squared_distr(size_t size, double k = 4,
+                            uint64_t seed = DEFAULT_SEED) {
+  return generate_from<T>(size, seed, chi_squared_distribution<>(k));
 }
 
 /**
- *
- * Adapted from
- * https://stackoverflow.com/questions/9983239/how-to-generate-zipf-distributed-numbers-efficiently
- *
- * NOTE: This generator is relatively slow, and the generation cannot be
- * parallelized due to static variables.
+ * @brief Samples from the Zipf distribution over {1, ..., cardinality} in
+ * O(1) expected time, using the rejection-inversion method of Hörmann and
+ * Derflinger ("Rejection-inversion to generate variates from monotone
+ * discrete distributions", 1996). Unlike inverting the CDF, it needs no
+ * precomputed table.
  */
-template <class T>
-vector<T> zipf_distr(size_t size, double skew = 0.75,
-                     size_t cardinality = 1e8) {
-  // Allocate space
-  vector<T> arr(size);
+class zipf_sampler {
+ public:
+  zipf_sampler(size_t cardinality, double skew)
+      : n(cardinality), exponent(skew) {
+    h_integral_x1 = h_integral(1.5) - 1;
+    h_integral_n = h_integral(n + 0.5);
+    s = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+  }
 
-  // Start generating numbers
-  for (size_t i = 0; i < size; ++i) {
-    static bool first = true;  // Static first time flag
-    static double c = 0;       // Normalization constant
-    static double *sum_probs;  // Pre-calculated sum of probabilities
-
-    // Compute normalization constant on first call only
-    if (first) {
-      for (size_t i = 1; i <= cardinality; ++i)
-        c = c + (1.0 / pow((double)i, skew));
-      c = 1.0 / c;
-
-      sum_probs = (double *)malloc((cardinality + 1) * sizeof(*sum_probs));
-      sum_probs[0] = 0;
-      for (size_t i = 1; i <= cardinality; ++i) {
-        sum_probs[i] = sum_probs[i - 1] + c / pow((double)i, skew);
+  template <class RNG>
+  size_t operator()(RNG &rng) const {
+    uniform_real_distribution<> uniform(0, 1);
+    while (true) {
+      const double u =
+          h_integral_n + uniform(rng) * (h_integral_x1 - h_integral_n);
+      const double x = h_integral_inverse(u);
+      double k = std::floor(x + 0.5);
+      k = std::max(1., std::min<double>(n, k));
+
+      // Accept the candidate if it falls under the histogram of the PMF
+      if (k - x <= s || u >= h_integral(k + 0.5) - h(k)) {
+        return static_cast<size_t>(k);
       }
-      first = false;
     }
+  }
 
-    // Pull a uniform random number (0 < z < 1)
-    double z;
-    do {
-      z = 1. * rand() / RAND_MAX;
-    } while ((z == 0) || (z == 1));
-
-    // Map z to the value
-    size_t low = 1, high = cardinality, mid;
-    T zipf_value = 0;  // Computed exponential value to be returned
-    do {
-      mid = floor((low + high) / 2);
-
-      if (sum_probs[mid] >= z && sum_probs[mid - 1] < z) {
-        zipf_value = mid;
-        break;
-      } else if (sum_probs[mid] >= z) {
-        high = mid - 1;
-      } else {
-        low = mid + 1;
-      }
-    } while (low <= high);
+ private:
+  // The integral of h(x) = x^-exponent
+  double h_integral(double x) const {
+    const double log_x = std::log(x);
+    return helper2((1 - exponent) * log_x) * log_x;
+  }
+
+  double h(double x) const { return std::exp(-exponent * std::log(x)); }
 
-    arr[i] = zipf_value;
+  double h_integral_inverse(double x) const {
+    double t = x * (1 - exponent);
+    if (t < -1) t = -1;  // Guard against rounding errors
+    return std::exp(helper1(t) * x);
   }
-  return arr;
+
+  // log(1 + x) / x, which is numerically stable around 0
+  static double helper1(double x) {
+    if (std::abs(x) > 1e-8) return std::log1p(x) / x;
+    return 1 - x * (0.5 - x * (1. / 3 - 0.25 * x));
+  }
+
+  // (exp(x) - 1) / x, which is numerically stable around 0
+  static double helper2(double x) {
+    if (std::abs(x) > 1e-8) return std::expm1(x) / x;
+    return 1 + x * 0.5 * (1 + x * (1. / 3) * (1 + 0.25 * x));
+  }
+
+  size_t n;
+  double exponent;
+  double h_integral_x1;
+  double h_integral_n;
+  double s;
+};
+
+template <class T>
+vector<T> zipf_distr(size_t size, double skew = 0.75, size_t cardinality = 1e8,
+                     uint64_t seed = DEFAULT_SEED) {
+  const zipf_sampler sampler(cardinality, skew);
+  return generate_blocks<T>(
+      size, seed,
+      [&](vector<T> &arr, size_t block_begin, size_t block_end,
+          block_rng &rng) {
+        for (size_t i = block_begin; i < block_end; ++i) {
+          arr[i] = sampler(rng);
+        }
+      });
 }
 
 /**
@@ -231,15 +315,8 @@ vector<T> zipf_distr(size_t size, double skew = 0.75,
  */
 template <class T>
 vector<T> root_dups_distr(size_t size) {
-  // Populate the input
-  vector<T> arr(size);
   const size_t root = std::sqrt(size);
-
-  for (size_t i = 0; i < size; i++) {
-    arr[i] = i % root;
-  }
-
-  return arr;
+  return generate_indexed<T>(size, [=](size_t i) { return i % root; });
 }
 
 /**
@@ -263,12 +340,10 @@ vector<T> two_dups_distr(size_t size) {
   }
 
   // Populate the input
-  vector<T> arr(size);
-  for (size_t i = 0; i < size; ++i) {
-    arr[i] = static_cast<T>((i * i + largest_power_of_two / 2) %
-                            largest_power_of_two);
-  }
-  return arr;
+  return generate_indexed<T>(size, [=](size_t i) {
+    return static_cast<T>((i * i + largest_power_of_two / 2) %
+                          largest_power_of_two);
+  });
 }
 
 /**
@@ -290,31 +365,64 @@ vector<T> eight_dups_distr(size_t size) {
         largest_power_of_two, std::numeric_limits<T>::max());
 
   // Populate the input
-  vector<T> arr(size);
-  for (size_t i = 0; i < size; ++i) {
+  return generate_indexed<T>(size, [=](size_t i) {
     unsigned long temp = (i * i) % largest_power_of_two;
     temp = (temp * temp) % largest_power_of_two;
-    arr[i] = static_cast<T>((temp * temp + largest_power_of_two / 2) %
-                            largest_power_of_two);
-  }
-  return arr;
+    return static_cast<T>((temp * temp + largest_power_of_two / 2) %
+                          largest_power_of_two);
+  });
 }
 
+/**
+ * Generates the order statistics of `size` uniform samples directly, instead
+ * of sorting them: the gaps between consecutive order statistics are
+ * exponentially distributed, so the keys are the normalized prefix sums of
+ * exponential samples.
+ */
 template <class T>
-vector<T> sorted_uniform_distr(size_t size) {
-  // Populate the input
-  vector<T> arr = uniform_distr<T>(size);
-
-  // Sort the input
-  std::sort(arr.begin(), arr.end());
-
-  return arr;
+vector<T> sorted_uniform_distr(size_t size, uint64_t seed = DEFAULT_SEED) {
+  // Use the same range as uniform_distr
+  double a = 0, b = size;
+  if (is_signed<T>::value) a = -1. * size;
+
+  // Generate the gaps and their prefix sums within each block
+  auto gaps = generate_blocks<double>(
+      size, seed,
+      [](vector<double> &arr, size_t block_begin, size_t block_end,
+         block_rng &rng) {
+        exponential_distribution<> distribution(1);
+        double sum = 0;
+        for (size_t i = block_begin; i < block_end; ++i) {
+          sum += distribution(rng);
+          arr[i] = sum;
+        }
+      });
+
+  // Compute the offset of each block. The extra gap after the last sample
+  // makes the samples fall strictly inside the range.
+  const size_t num_blocks =
+      (size + GENERATOR_BLOCK_SZ - 1) / GENERATOR_BLOCK_SZ;
+  vector<double> offsets(num_blocks + 1, 0);
+  for (size_t i = 0; i < num_blocks; ++i) {
+    const size_t block_end = std::min((i + 1) * GENERATOR_BLOCK_SZ, size);
+    offsets[i + 1] = offsets[i] + gaps[block_end - 1];
+  }
+  block_rng last_gap_rng(seed, num_blocks);
+  const double total =
+      offsets[num_blocks] + exponential_distribution<>(1)(last_gap_rng);
+
+  // Scale the prefix sums to the range
+  return generate_indexed<T>(size, [&](size_t i) {
+    return static_cast<T>(
+        a + (b - a) * ((offsets[i / GENERATOR_BLOCK_SZ] + gaps[i]) / total));
+  });
 }
 
 template <class T>
-vector<T> reverse_sorted_uniform_distr(size_t size) {
+vector<T> reverse_sorted_uniform_distr(size_t size,
+                                       uint64_t seed = DEFAULT_SEED) {
   // Populate the input
-  vector<T> arr = sorted_uniform_distr<T>(size);
+  vector<T> arr = sorted_uniform_distr<T>(size, seed);
 
   // Reverse the input
   std::reverse(arr.begin(), arr.end());
@@ -25,6 +25,7 @@
 #include "ips4o.hpp"
 #include "learned_sort.h"
 #include "pdqsort.h"
+#include "perf_counters.h"
 #include "radix_sort.h"
 #include "ska_sort.hpp"
 #include "utils.h"
@@ -77,17 +78,12 @@ class Benchmarks : public benchmark::Fixture {
     }
 
     // Verify that the array is sorted
-    for (size_t i = 1; i < arr.size(); i++) {
-      if (arr[i] < arr[i - 1]) {
-        if (i == arr.size() - 1)
-          cout << "Unsorted elements in position " << i << ": ..." << arr[i - 1]
-               << ", " << arr[i] << ".\n";
-        else
-          cout << "Unsorted elements in position " << i << ": ..." << arr[i - 1]
-               << ", " << arr[i] << ", " << arr[i + 1] << "...\n";
-        exit(EXIT_FAILURE);
-      }
+    auto unsorted = parallel_is_sorted_until(arr.begin(), arr.end());
+    if (unsorted != arr.end()) {
+      print_unsorted(arr, unsorted - arr.begin());
+      exit(EXIT_FAILURE);
     }
+
     // Clenaup
     arr.clear();
   }
@@ -102,15 +98,21 @@ class Benchmarks : public benchmark::Fixture {
 #define SORT_BENCHMARK_DEFINE(SortFnName, SortFnCall) \
   BENCHMARK_DEFINE_F(Benchmarks, SortFnName)          \
   (benchmark::State & state) {                        \
+    perf_counters counters;                           \
     for (auto _ : state) {                            \
+      counters.start();                               \
       SortFnCall;                                     \
+      counters.stop();                                \
     }                                                 \
+    counters.report(state, arr.size());               \
   }                                                   \
   BENCHMARK_REGISTER_F(Benchmarks, SortFnName)->Apply(benchmark_arguments);
 
 // Register the benchmarks
 SORT_BENCHMARK_DEFINE(LearnedSort,
                       learned_sort::sort(arr.begin(), arr.end()))
+SORT_BENCHMARK_DEFINE(LearnedSortTotalOrder,
+                      learned_sort::sort_total_order(arr.begin(), arr.end()))
 SORT_BENCHMARK_DEFINE(RadixSort, radix_sort(arr.begin(), arr.end()))
 SORT_BENCHMARK_DEFINE(IS4o, ips4o::sort(arr.begin(), arr.end()))
 SORT_BENCHMARK_DEFINE(StdSort, std::sort(arr.begin(), arr.end()))
@@ -19,107 +19,447 @@
 #include <benchmark/benchmark.h>
 
 #include <algorithm>
+#include <bit>
+#include <cstring>
+#include <functional>
+#include <memory_resource>
+#include <string>
+#include <thread>
+#include <utility>
 
 #include "blocked_double_pivot_check_mosqrt.h++"
 #include "gfx/timsort.hpp"
 #include "ips4o.hpp"
 #include "pdqsort.h"
 #include "learned_sort.h"
+#include "perf_counters.h"
 #include "radix_sort.h"
 #include "ska_sort.hpp"
 #include "utils.h"
 
 using namespace std;
 
-// NOTE: You may change the data type here
-typedef double data_t;
-
-// NOTE: You may change the distribution here.
+// NOTE: The benchmarks are registered for every combination of the
+// distributions, input sizes, key types and thread counts below. Use the
+// option --benchmark_filter to run a subset of them.
 // For a list of supported distributions see src/utils.h
-distr_t DATA_DISTR = NORMAL;
+const vector<pair<distr_t, string>> DISTRIBUTIONS = {
+    {CHI_SQUARED, "ChiSquared"},
+    {EIGHT_DUPS, "EightDups"},
+    {EXPONENTIAL, "Exponential"},
+    {IDENTICAL, "Identical"},
+    {LOGNORMAL, "Lognormal"},
+    {MIX_GAUSS, "MixGauss"},
+    {MODULO, "Modulo"},
+    {NORMAL, "Normal"},
+    {REVERSE_SORTED_UNIFORM, "ReverseSortedUniform"},
+    {ROOT_DUPS, "RootDups"},
+    {SORTED_UNIFORM, "SortedUniform"},
+    {TWO_DUPS, "TwoDups"},
+    {UNIFORM, "Uniform"},
+    {ZIPF, "Zipf"}};
+
+// NOTE: You may change the range of input sizes here
+constexpr size_t MIN_INPUT_SZ = 100'000;
+constexpr size_t MAX_INPUT_SZ = 1'000'000'000;
+constexpr size_t INPUT_SZ_MULTIPLIER = 10;
+
+// NOTE: You may change the maximum number of threads here. The thread counts
+// are the powers of two up to this number, and the number itself.
+const size_t MAX_THREADS = std::max(1u, thread::hardware_concurrency());
+
+// The input size for benchmarking different numbers of leaf models
+constexpr size_t LEAF_MODELS_INPUT_SZ = 50'000'000;
+
+// The largest allocation of LearnedSort that is pooled in the huge pages, when
+// benchmarking with huge pages. Larger ones are mapped to huge pages directly.
+constexpr size_t HUGE_PAGE_POOL_MAX_BLOCK_SZ = 1 << 20;
 
-// NOTE: You may change the input size here
-constexpr size_t INPUT_SZ = 50'000'000;
+// The input size for benchmarking the variants of the partitioning kernel
+constexpr size_t KERNEL_INPUT_SZ = 10'000'000;
+
+// The number of fractional bits of the fixed-point CDF that the multiply-shift
+// variant of the partitioning kernel computes
+constexpr int KERNEL_CDF_FRACTION_BITS = 32;
 
 constexpr size_t REP_LARGE_INPUTS = 5;
 constexpr size_t REP_SMALL_INPUTS = 10;
 
-static void benchmark_arguments(benchmark::internal::Benchmark *b) {
-  b->Arg(INPUT_SZ);
-  b->Unit(benchmark::kMillisecond);
+// Sorts the range [begin, end)
+template <class T>
+using sort_fn_t = function<void(typename vector<T>::iterator,
+                                typename vector<T>::iterator)>;
+
+// Frees the dataset that is currently cached, whatever its key type
+function<void()> release_cached_dataset = [] {};
+
+// A generated dataset along with its checksum
+template <class T>
+struct dataset_t {
+  distr_t distr;
+  size_t size = 0;
+  vector<T> keys;
+  long long cksm;
+};
+
+/**
+ * @brief Returns the keys of the given distribution and size. Only the most
+ * recently requested dataset is kept in memory, so the benchmarks that share a
+ * dataset are registered next to each other.
+ */
+template <class T>
+const dataset_t<T> &get_dataset(distr_t distr, size_t size) {
+  static dataset_t<T> cached;
+
+  if (cached.size != size || cached.distr != distr) {
+    // Free the previous dataset before generating the next one
+    release_cached_dataset();
+    release_cached_dataset = [] {
+      vector<T>().swap(cached.keys);
+      cached.size = 0;
+    };
+
+    cached.keys = generate_data<T>(distr, size);
+    cached.cksm = get_checksum(cached.keys);
+    cached.distr = distr;
+    cached.size = size;
+  }
+  return cached;
 }
 
-class Benchmarks : public benchmark::Fixture {
- public:
-  Benchmarks() {
-    if (INPUT_SZ < 1e8)
-      Repetitions(REP_SMALL_INPUTS);
-    else
-      Repetitions(REP_LARGE_INPUTS);
+// Sorts `num_threads` equally-sized slices of the array concurrently
+template <class T>
+void sort_slices(vector<T> &arr, size_t num_threads, const sort_fn_t<T> &sort) {
+  if (num_threads <= 1) {
+    sort(arr.begin(), arr.end());
+    return;
   }
 
- protected:
-  void SetUp(const ::benchmark::State &state) {
-    // Generate the synthetic data
-    size_t size = state.range(0);
-    arr = generate_data<data_t>(DATA_DISTR, size);
+  const size_t slice_sz = (arr.size() + num_threads - 1) / num_threads;
+  vector<thread> threads;
+  for (size_t i = 0; i < num_threads; i++) {
+    const size_t slice_begin = std::min(i * slice_sz, arr.size());
+    const size_t slice_end = std::min(slice_begin + slice_sz, arr.size());
+    threads.emplace_back(sort, arr.begin() + slice_begin,
+                         arr.begin() + slice_end);
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+}
 
-    // Calculate the checksum
-    cksm = get_checksum(arr);
+// Exits if the array is not a permutation of the dataset, or if any of the
+// slices that were sorted concurrently is not sorted
+template <class T>
+void verify(const vector<T> &arr, const dataset_t<T> &dataset,
+            size_t num_threads) {
+  // Verify that the array's checksum is correct
+  if (get_checksum(arr) != dataset.cksm) {
+    cerr << "Incorrect checksum! Exiting." << endl;
+    exit(EXIT_FAILURE);
   }
 
-  void TearDown(const ::benchmark::State &state) {
-    // Verify that the array's checksum is correct
-    if (get_checksum(arr) != cksm) {
-      cerr << "Incorrect checksum! Exiting." << endl;
+  // Verify that each slice is sorted
+  const size_t slice_sz = (arr.size() + num_threads - 1) / num_threads;
+  for (size_t slice_begin = 0; slice_begin < arr.size();
+       slice_begin += slice_sz) {
+    auto slice_end = arr.begin() + std::min(slice_begin + slice_sz, arr.size());
+    auto unsorted = parallel_is_sorted_until(arr.begin() + slice_begin,
+                                             slice_end);
+    if (unsorted != slice_end) {
+      print_unsorted(arr, unsorted - arr.begin());
       exit(EXIT_FAILURE);
     }
+  }
+}
+
+// Measures the sorting function on a fresh copy of the dataset in every
+// iteration, and reports the throughput in keys/s and bytes/s, as well as the
+// hardware counters per key. LearnedSort allocates its internal buffers from
+// the given memory resource, if any.
+template <class T>
+void sort_benchmark(benchmark::State &state, distr_t distr,
+                    const sort_fn_t<T> &sort,
+                    std::pmr::memory_resource *scratch) {
+  const size_t size = state.range(0);
+  const size_t num_threads = state.range(1);
+  const auto &dataset = get_dataset<T>(distr, size);
+
+  auto *prev_scratch = learned_sort::utils::scratch_resource();
+  if (scratch != nullptr) learned_sort::utils::set_scratch_resource(scratch);
+
+  vector<T> arr(size);
+  perf_counters counters;
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::copy(dataset.keys.begin(), dataset.keys.end(), arr.begin());
+    state.ResumeTiming();
+
+    counters.start();
+    sort_slices(arr, num_threads, sort);
+    counters.stop();
+  }
+  learned_sort::utils::set_scratch_resource(prev_scratch);
+  verify(arr, dataset, num_threads);
+
+  counters.report(state, size);
+
+  state.SetItemsProcessed(state.iterations() * size);
+  state.SetBytesProcessed(state.iterations() * size * sizeof(T));
+}
+
+/**
+ * @brief Predicts the primary bucket of every key in `keys` with the trained
+ * `rmi`, and scatters the keys to fragments of PRIMARY_FRAGMENT_CAPACITY keys,
+ * which are flushed to `out` when they fill up, like the partitioning step of
+ * LearnedSort. Returns the number of flushed keys.
+ *
+ * The variants of the kernel fix the number of leaf models and the fanout at
+ * compile time, or read the number of leaf models from `rmi` when
+ * `NumLeafModels` is 0. Like in LearnedSort, the indexes are clamped in
+ * floating point before they are truncated, unless `MultiplyShift` is set.
+ * Then they are truncated first and clamped as integers, and the bucket is
+ * given by the top bits of the CDF in fixed point. Truncating first is only
+ * defined for predictions within the range of long, which holds for the keys
+ * that the model was trained on.
+ */
+template <long NumLeafModels, long Fanout, bool MultiplyShift, class T>
+long partition_kernel(const vector<T> &keys, const TwoLayerRMI<T> &rmi,
+                      vector<T> &fragments, vector<T> &out) {
+  static_assert(!MultiplyShift || std::has_single_bit<unsigned long>(Fanout),
+                "Multiply-shift partitioning requires a power-of-two fanout");
+  const long num_leaf_models =
+      NumLeafModels > 0 ? NumLeafModels : rmi.hp.num_leaf_models;
+  const double root_slope = rmi.root_model.slope;
+  const double root_intercept = rmi.root_model.intercept;
+  const linear_model<double> *leaf_models = rmi.leaf_models.data();
+
+  auto clamp_index = [](long idx, long max_idx) {
+    return idx < 0 ? 0 : (idx > max_idx ? max_idx : idx);
+  };
+  auto bucket_of = [&](T key) -> long {
+    if constexpr (MultiplyShift) {
+      const long leaf_idx =
+          clamp_index(static_cast<long>(root_slope * key + root_intercept),
+                      num_leaf_models - 1);
+      const auto &leaf = leaf_models[leaf_idx];
+      const long fixed_cdf =
+          clamp_index(static_cast<long>((leaf.slope * key + leaf.intercept) *
+                                        (1L << KERNEL_CDF_FRACTION_BITS)),
+                      (1L << KERNEL_CDF_FRACTION_BITS) - 1);
+      constexpr int bucket_bits = std::countr_zero<unsigned long>(Fanout);
+      return fixed_cdf >> (KERNEL_CDF_FRACTION_BITS - bucket_bits);
+    } else {
+      const long leaf_idx = static_cast<long>(
+          std::max(0., std::min(num_leaf_models - 1.,
+                                root_slope * key + root_intercept)));
+      const auto &leaf = leaf_models[leaf_idx];
+      return static_cast<long>(
+          std::max(0., std::min(Fanout - 1., (leaf.slope * key +
+                                              leaf.intercept) * Fanout)));
+    }
+  };
 
-    // Verify that the array is sorted
-    for (size_t i = 1; i < arr.size(); i++) {
-      if (arr[i] < arr[i - 1]) {
-        if (i == arr.size() - 1)
-          cout << "Unsorted elements in position " << i << ": ..." << arr[i - 1]
-               << ", " << arr[i] << ".\n";
-        else
-          cout << "Unsorted elements in position " << i << ": ..." << arr[i - 1]
-               << ", " << arr[i] << ", " << arr[i + 1] << "...\n";
-        exit(EXIT_FAILURE);
+  // Predict the buckets of a batch of keys, and then scatter them, as in
+  // LearnedSort
+  long fragment_sizes[Fanout]{0};
+  long pred_buckets[PREDICTION_BATCH_SZ];
+  long num_flushed = 0;
+  const long input_sz = keys.size();
+  for (long batch_off = 0; batch_off < input_sz;
+       batch_off += PREDICTION_BATCH_SZ) {
+    const long batch_sz =
+        std::min<long>(PREDICTION_BATCH_SZ, input_sz - batch_off);
+    for (long i = 0; i < batch_sz; ++i) {
+      pred_buckets[i] = bucket_of(keys[batch_off + i]);
+    }
+    for (long i = 0; i < batch_sz; ++i) {
+      const long bucket_idx = pred_buckets[i];
+      T *fragment = fragments.data() + bucket_idx * PRIMARY_FRAGMENT_CAPACITY;
+      fragment[fragment_sizes[bucket_idx]++] = keys[batch_off + i];
+      if (fragment_sizes[bucket_idx] == PRIMARY_FRAGMENT_CAPACITY) {
+        std::copy(fragment, fragment + PRIMARY_FRAGMENT_CAPACITY,
+                  out.begin() + num_flushed);
+        num_flushed += PRIMARY_FRAGMENT_CAPACITY;
+        fragment_sizes[bucket_idx] = 0;
       }
     }
+  }
+  return num_flushed;
+}
 
-    // Cleanup
-    arr.clear();
+// Measures a variant of the partitioning kernel (see partition_kernel()) with
+// a model that is trained on the dataset beforehand
+template <class T, long NumLeafModels, long Fanout, bool MultiplyShift>
+void kernel_benchmark(benchmark::State &state, distr_t distr) {
+  const size_t size = state.range(0);
+  const auto &dataset = get_dataset<T>(distr, size);
+
+  typename TwoLayerRMI<T>::Params params;
+  if (NumLeafModels > 0) params.num_leaf_models = NumLeafModels;
+  TwoLayerRMI<T> rmi(params);
+  if (!rmi.train(dataset.keys.begin(), dataset.keys.end())) {
+    state.SkipWithError("The CDF model could not be trained");
+    return;
   }
 
-  // Input array
-  vector<data_t> arr;
+  vector<T> fragments(Fanout * PRIMARY_FRAGMENT_CAPACITY);
+  vector<T> out(size);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        partition_kernel<NumLeafModels, Fanout, MultiplyShift>(
+            dataset.keys, rmi, fragments, out));
+    benchmark::ClobberMemory();
+  }
 
-  // Checksum
-  long long cksm;
-};
+  state.SetItemsProcessed(state.iterations() * size);
+  state.SetBytesProcessed(state.iterations() * size * sizeof(T));
+}
+
+// Registers a benchmark that is named after the algorithm, the distribution
+// and the key type, and is parameterized by the input size and thread count
+template <class T>
+benchmark::internal::Benchmark *register_sort_benchmark(
+    const string &name, distr_t distr, size_t size, size_t num_threads,
+    sort_fn_t<T> sort, std::pmr::memory_resource *scratch = nullptr) {
+  return benchmark::RegisterBenchmark(
+             name.c_str(),
+             [=](benchmark::State &state) {
+               sort_benchmark<T>(state, distr, sort, scratch);
+             })
+      ->Args({static_cast<long>(size), static_cast<long>(num_threads)})
+      ->Unit(benchmark::kMillisecond)
+      ->Repetitions(size < 1e8 ? REP_SMALL_INPUTS : REP_LARGE_INPUTS)
+      ->UseRealTime();
+}
+
+// Returns a thread-safe pool of huge pages for the internal buffers of
+// LearnedSort
+std::pmr::memory_resource *huge_page_scratch() {
+  static learned_sort::utils::huge_page_resource huge_pages;
+  static std::pmr::synchronized_pool_resource pool(
+      std::pmr::pool_options{0, HUGE_PAGE_POOL_MAX_BLOCK_SZ}, &huge_pages);
+  return &pool;
+}
 
-#define SORT_BENCHMARK_DEFINE(SortFnName, SortFnCall) \
-  BENCHMARK_DEFINE_F(Benchmarks, SortFnName)          \
-  (benchmark::State & state) {                        \
-    for (auto _ : state) {                            \
-      SortFnCall;                                     \
-    }                                                 \
-  }                                                   \
-  BENCHMARK_REGISTER_F(Benchmarks, SortFnName)->Apply(benchmark_arguments);
-
-// Register the benchmarks
-SORT_BENCHMARK_DEFINE(LearnedSort,
-                      learned_sort::sort(arr.begin(),
-                      arr.end()))
-SORT_BENCHMARK_DEFINE(RadixSort, radix_sort(arr.begin(), arr.end()))
-SORT_BENCHMARK_DEFINE(IS4o, ips4o::sort(arr.begin(), arr.end()))
-SORT_BENCHMARK_DEFINE(StdSort, std::sort(arr.begin(), arr.end()))
-SORT_BENCHMARK_DEFINE(BlockQuicksort,
-                      blocked_double_pivot_check_mosqrt::sort(arr))
-SORT_BENCHMARK_DEFINE(SkaSort, ska_sort(arr.begin(), arr.end()))
-SORT_BENCHMARK_DEFINE(Timsort, gfx::timsort(arr.begin(), arr.end()))
-SORT_BENCHMARK_DEFINE(PDQS, pdqsort(arr.begin(), arr.end()))
-
-// Run the benchmark
-BENCHMARK_MAIN();
+// Registers the benchmarks of all the algorithms on keys of type T
+template <class T>
+void register_benchmarks(const string &type_name) {
+  typedef typename vector<T>::iterator It;
+  const vector<pair<string, sort_fn_t<T>>> algorithms = {
+      {"LearnedSort", [](It begin, It end) { learned_sort::sort(begin, end); }},
+      {"RadixSort", [](It begin, It end) { radix_sort(begin, end); }},
+      {"IS4o", [](It begin, It end) { ips4o::sort(begin, end); }},
+      {"StdSort", [](It begin, It end) { std::sort(begin, end); }},
+      {"BlockQuicksort",
+       [](It begin, It end) {
+         blocked_double_pivot_check_mosqrt::sort(begin, end, std::less<T>());
+       }},
+      {"SkaSort", [](It begin, It end) { ska_sort(begin, end); }},
+      {"Timsort", [](It begin, It end) { gfx::timsort(begin, end); }},
+      {"PDQS", [](It begin, It end) { pdqsort(begin, end); }}};
+
+  vector<size_t> thread_counts;
+  for (size_t t = 1; t < MAX_THREADS; t *= 2) {
+    thread_counts.push_back(t);
+  }
+  thread_counts.push_back(MAX_THREADS);
+
+  // The algorithms are the innermost dimension, so that each dataset is
+  // generated only once
+  for (const auto &[distr, distr_name] : DISTRIBUTIONS) {
+    for (size_t size = MIN_INPUT_SZ; size <= MAX_INPUT_SZ;
+         size *= INPUT_SZ_MULTIPLIER) {
+      for (auto num_threads : thread_counts) {
+        for (const auto &[algo_name, sort] : algorithms) {
+          register_sort_benchmark<T>(
+              algo_name + "/" + distr_name + "/" + type_name, distr, size,
+              num_threads, sort);
+        }
+
+        // Compare against LearnedSort with its buffers in huge pages
+        register_sort_benchmark<T>(
+            "LearnedSortHugePages/" + distr_name + "/" + type_name, distr,
+            size, num_threads, algorithms[0].second, huge_page_scratch());
+      }
+    }
+  }
+}
+
+// Registers the benchmarks of LearnedSort for different numbers of leaf models
+// in the CDF model
+void register_leaf_models_benchmarks() {
+  typedef vector<double>::iterator It;
+  for (long num_leaf_models = 1'000; num_leaf_models <= 1'000'000;
+       num_leaf_models *= 10) {
+    // Sample enough keys to train every leaf model
+    TwoLayerRMI<double>::Params params;
+    params.num_leaf_models = num_leaf_models;
+    params.sampling_rate = std::min(
+        1., std::max<double>(params.sampling_rate,
+                             10. * num_leaf_models / LEAF_MODELS_INPUT_SZ));
+
+    register_sort_benchmark<double>(
+        "LearnedSortLeafModels/" + to_string(num_leaf_models) +
+            "/Normal/double",
+        NORMAL, LEAF_MODELS_INPUT_SZ, 1,
+        [params](It begin, It end) {
+          auto hp = params;
+          learned_sort::sort(begin, end, hp);
+        });
+  }
+}
+
+// Registers the benchmarks of the variants of the partitioning kernel of
+// LearnedSort on keys of type T, which specialize it for the number of leaf
+// models and the fanout (see partition_kernel())
+template <class T>
+void register_kernel_benchmarks(const string &type_name) {
+  typedef void (*kernel_fn_t)(benchmark::State &, distr_t);
+  const vector<pair<string, kernel_fn_t>> variants = {
+      {"Runtime", kernel_benchmark<T, 0, PRIMARY_FANOUT, false>},
+      {"Fixed", kernel_benchmark<T, 1000, 1000, false>},
+      {"PowerOfTwo", kernel_benchmark<T, 1024, 1024, false>},
+      {"MultiplyShift", kernel_benchmark<T, 1024, 1024, true>}};
+
+  for (const auto &[distr, distr_name] : DISTRIBUTIONS) {
+    for (const auto &[variant_name, kernel] : variants) {
+      benchmark::RegisterBenchmark(
+          ("LearnedSortKernel/" + variant_name + "/" + distr_name + "/" +
+           type_name)
+              .c_str(),
+          [=](benchmark::State &state) { kernel(state, distr); })
+          ->Arg(KERNEL_INPUT_SZ)
+          ->Unit(benchmark::kMillisecond)
+          ->Repetitions(REP_SMALL_INPUTS)
+          ->UseRealTime();
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  // Register the benchmarks
+  register_benchmarks<double>("double");
+  register_benchmarks<uint64_t>("uint64");
+  register_benchmarks<uint32_t>("uint32");
+  register_leaf_models_benchmarks();
+
+  // The variants of the partitioning kernel are only registered on request
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--learned_sort_kernels") == 0) {
+      register_kernel_benchmarks<double>("double");
+      register_kernel_benchmarks<uint64_t>("uint64");
+      register_kernel_benchmarks<uint32_t>("uint32");
+      std::copy(argv + i + 1, argv + argc, argv + i);
+      --argc;
+      break;
+    }
+  }
+
+  // Run the benchmarks
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
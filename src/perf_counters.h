@@ -0,0 +1,163 @@
+#pragma once
+
+/**
+ * @file perf_counters.h
+ * @author Ani Kristo (anikristo@gmail.com)
+ * @brief Hardware performance counters for the benchmarks
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo (anikristo@gmail.com)
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The counters are collected only when the benchmarks are built with the
+// CMake option PERF_COUNTERS=ON, and only on Linux
+#if defined(LEARNEDSORT_PERF_COUNTERS) && defined(__linux__)
+#define PERF_COUNTERS_AVAILABLE
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/**
+ * @brief Counts hardware events (cycles, instructions, L1D and LLC misses,
+ * branch misses and dTLB misses) with perf_event_open, while it is started.
+ * The events of the threads that are spawned while counting are included.
+ *
+ * The events that cannot be opened (e.g., because of the setting of
+ * /proc/sys/kernel/perf_event_paranoid, or inside a VM) are skipped, and
+ * nothing is counted when the counters are not available.
+ */
+class perf_counters {
+ public:
+  perf_counters() {
+#ifdef PERF_COUNTERS_AVAILABLE
+    for (const auto &event : EVENTS) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = event.type;
+      attr.config = event.config;
+      attr.disabled = 1;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format =
+          PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+      if (fd < 0) {
+        static bool warned = false;
+        if (!warned) {
+          cerr << "Cannot open hardware counter " << event.name
+               << ". Check /proc/sys/kernel/perf_event_paranoid." << endl;
+          warned = true;
+        }
+        continue;
+      }
+      counters.push_back({event.name, fd});
+    }
+#endif
+  }
+
+  ~perf_counters() {
+#ifdef PERF_COUNTERS_AVAILABLE
+    for (const auto &counter : counters) {
+      close(counter.fd);
+    }
+#endif
+  }
+
+  perf_counters(const perf_counters &) = delete;
+  perf_counters &operator=(const perf_counters &) = delete;
+
+  // Resumes counting
+  inline void start() {
+#ifdef PERF_COUNTERS_AVAILABLE
+    for (const auto &counter : counters) {
+      ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  // Pauses counting
+  inline void stop() {
+#ifdef PERF_COUNTERS_AVAILABLE
+    for (const auto &counter : counters) {
+      ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+#endif
+  }
+
+  /**
+   * @brief Reports the events counted so far as user counters of the
+   * benchmark, averaged per sorted key.
+   *
+   * @param num_keys The number of keys sorted in each iteration
+   */
+  void report(benchmark::State &state, size_t num_keys) const {
+#ifdef PERF_COUNTERS_AVAILABLE
+    const double total_keys = 1. * state.iterations() * num_keys;
+    if (total_keys == 0) return;
+
+    for (const auto &counter : counters) {
+      uint64_t values[3];  // The value, time enabled and time running
+      if (read(counter.fd, values, sizeof(values)) != sizeof(values)) continue;
+
+      // Scale up the value if the counter was multiplexed with others
+      double value = values[2] > 0 ? 1. * values[0] * values[1] / values[2] : 0;
+      state.counters[counter.name + "/key"] = value / total_keys;
+    }
+#endif
+  }
+
+ private:
+#ifdef PERF_COUNTERS_AVAILABLE
+  struct event_t {
+    string name;
+    uint32_t type;
+    uint64_t config;
+  };
+
+  // Returns the configuration of a read miss in the given cache
+  static constexpr uint64_t cache_read_miss(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  }
+
+  inline static const vector<event_t> EVENTS = {
+      {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {"L1D_misses", PERF_TYPE_HW_CACHE,
+       cache_read_miss(PERF_COUNT_HW_CACHE_L1D)},
+      {"LLC_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+      {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      {"dTLB_misses", PERF_TYPE_HW_CACHE,
+       cache_read_miss(PERF_COUNT_HW_CACHE_DTLB)}};
+
+  struct counter_t {
+    string name;
+    int fd;
+  };
+
+  vector<counter_t> counters;
+#endif
+};
@@ -20,6 +20,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
 #include "generators.h"
 
 using namespace std;
@@ -42,68 +50,119 @@ enum distr_t {
   ZIPF
 };
 
-// Helper table for hash values for the checksum function
-static constexpr unsigned short crc_table[256] = {
-    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7, 0x8108,
-    0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef, 0x1231, 0x0210,
-    0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6, 0x9339, 0x8318, 0xb37b,
-    0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de, 0x2462, 0x3443, 0x0420, 0x1401,
-    0x64e6, 0x74c7, 0x44a4, 0x5485, 0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee,
-    0xf5cf, 0xc5ac, 0xd58d, 0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6,
-    0x5695, 0x46b4, 0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d,
-    0xc7bc, 0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
-    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b, 0x5af5,
-    0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12, 0xdbfd, 0xcbdc,
-    0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a, 0x6ca6, 0x7c87, 0x4ce4,
-    0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41, 0xedae, 0xfd8f, 0xcdec, 0xddcd,
-    0xad2a, 0xbd0b, 0x8d68, 0x9d49, 0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13,
-    0x2e32, 0x1e51, 0x0e70, 0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a,
-    0x9f59, 0x8f78, 0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e,
-    0xe16f, 0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
-    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e, 0x02b1,
-    0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256, 0xb5ea, 0xa5cb,
-    0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d, 0x34e2, 0x24c3, 0x14a0,
-    0x0481, 0x7466, 0x6447, 0x5424, 0x4405, 0xa7db, 0xb7fa, 0x8799, 0x97b8,
-    0xe75f, 0xf77e, 0xc71d, 0xd73c, 0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657,
-    0x7676, 0x4615, 0x5634, 0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9,
-    0xb98a, 0xa9ab, 0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882,
-    0x28a3, 0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
-    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92, 0xfd2e,
-    0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9, 0x7c26, 0x6c07,
-    0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1, 0xef1f, 0xff3e, 0xcf5d,
-    0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8, 0x6e17, 0x7e36, 0x4e55, 0x5e74,
-    0x2e93, 0x3eb2, 0x0ed1, 0x1ef0};
-
-// CRC32 checksum calculation
+// Runs `fn(thread_idx, chunk_begin, chunk_end)` on generator_threads()
+// contiguous chunks of [0, size) concurrently
+template <class Fn>
+void parallel_for_chunks(size_t size, Fn fn) {
+  const size_t num_threads =
+      std::max<size_t>(1, std::min(generator_threads(), size));
+  const size_t chunk_sz = (size + num_threads - 1) / num_threads;
+
+  vector<thread> threads;
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(fn, i, std::min(i * chunk_sz, size),
+                         std::min((i + 1) * chunk_sz, size));
+  }
+  fn(0, 0, std::min(chunk_sz, size));
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+// Hashes the bytes of a key
 template <class T>
-long long int get_checksum(vector<T> arr) {
-  constexpr auto BYTE_SZ = 8;
-  constexpr auto BYTE_MASK = 0xFF;
+inline uint64_t key_hash(const T &key) {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  uint64_t hash = 0;
+  for (size_t offset = 0; offset < sizeof(T); offset += sizeof(uint64_t)) {
+    uint64_t word = 0;
+    std::memcpy(&word, reinterpret_cast<const char *>(&key) + offset,
+                std::min(sizeof(T) - offset, sizeof(uint64_t)));
+    hash = mix64(hash ^ word);
+  }
+  return hash;
+}
 
-  long long int total_checksum = 0, local_checksum = 0;
-  long long int temp;
+/**
+ * @brief Computes a fingerprint of the multiset of keys in the array, which
+ * does not depend on their order: the sum of the hashes of the keys. This is
+ * used to check that sorting produced a permutation of its input.
+ */
+template <class T>
+long long int get_checksum(const vector<T> &arr) {
+  vector<uint64_t> partial_sums(generator_threads(), 0);
+
+  parallel_for_chunks(arr.size(), [&](size_t thread_idx, size_t chunk_begin,
+                                      size_t chunk_end) {
+    uint64_t sum = 0;
+    for (size_t i = chunk_begin; i < chunk_end; i++) {
+      sum += key_hash(arr[i]);
+    }
+    partial_sums[thread_idx] = sum;
+  });
 
-  vector<T> cpy(arr.begin(), arr.end());
+  return std::accumulate(partial_sums.begin(), partial_sums.end(),
+                         uint64_t(0));
+}
 
-  for (size_t i = 0; i < arr.size(); i++) {
-    for (size_t j = 0; j < sizeof(T); j++) {
-      temp = ((short)(((char *)(cpy.data() + i))[j])++ ^
-              (local_checksum >> BYTE_SZ)) &
-             BYTE_MASK;
-      local_checksum = crc_table[temp] ^ (local_checksum << BYTE_SZ);
+/**
+ * @brief A parallel version of std::is_sorted_until, which returns the first
+ * iterator `it` in [begin + 1, end) for which *it < *(it - 1), or `end` if
+ * the range is sorted.
+ */
+template <class RandomIt>
+RandomIt parallel_is_sorted_until(RandomIt begin, RandomIt end) {
+  // The number of comparisons that are checked without branching
+  constexpr size_t BLOCK_SZ = 1024;
+
+  const size_t size = std::distance(begin, end);
+  if (size < 2) return end;
+
+  // Each thread checks the pairs (i, i + 1) for every i in its chunk
+  vector<size_t> first_unsorted(generator_threads(), size);
+  parallel_for_chunks(size - 1, [&](size_t thread_idx, size_t chunk_begin,
+                                    size_t chunk_end) {
+    for (size_t block = chunk_begin; block < chunk_end; block += BLOCK_SZ) {
+      const size_t block_end = std::min(block + BLOCK_SZ, chunk_end);
+
+      unsigned unsorted = 0;
+      for (size_t i = block; i < block_end; i++) {
+        unsorted |= begin[i + 1] < begin[i];
+      }
+
+      // Find the exact position only in the block that is unsorted
+      if (unsorted) {
+        first_unsorted[thread_idx] =
+            std::is_sorted_until(begin + block, begin + block_end + 1) - begin;
+        return;
+      }
     }
-    total_checksum += local_checksum;
-    local_checksum = 0;
-  }
-  return total_checksum;
+  });
+
+  return begin + *std::min_element(first_unsorted.begin(),
+                                   first_unsorted.end());
+}
+
+// Prints the keys around position `i`, which is out of order
+template <class T>
+void print_unsorted(const vector<T> &arr, size_t i) {
+  if (i == arr.size() - 1)
+    cout << "Unsorted elements in position " << i << ": ..." << arr[i - 1]
+         << ", " << arr[i] << ".\n";
+  else
+    cout << "Unsorted elements in position " << i << ": ..." << arr[i - 1]
+         << ", " << arr[i] << ", " << arr[i + 1] << "...\n";
 }
 
-// Utility to return the right distribution of the array
+// Utility to return the right distribution of the array. The same seed always
+// generates the same array.
 template <class T>
-vector<T> generate_data(distr_t data_distr, size_t size) {
+vector<T> generate_data(distr_t data_distr, size_t size,
+                        uint64_t seed = DEFAULT_SEED) {
   switch (data_distr) {
     case CHI_SQUARED:
-      return chi_squared_distr<T>(size);
+      return chi_squared_distr<T>(size, 4, seed);
       break;
 
     case EIGHT_DUPS:
@@ -111,7 +170,7 @@ vector<T> generate_data(distr_t data_distr, size_t size) {
       break;
 
     case EXPONENTIAL:
-      return exponential_distr<T>(size);
+      return exponential_distr<T>(size, 2, seed);
       break;
 
     case IDENTICAL:
@@ -119,11 +178,11 @@ vector<T> generate_data(distr_t data_distr, size_t size) {
       break;
 
     case LOGNORMAL:
-      return lognormal_distr<T>(size);
+      return lognormal_distr<T>(size, 0, 0.5, 0, seed);
       break;
 
     case MIX_GAUSS:
-      return mix_of_gauss_distr<T>(size);
+      return mix_of_gauss_distr<T>(size, 5, seed);
       break;
 
     case MODULO:
@@ -131,11 +190,11 @@ vector<T> generate_data(distr_t data_distr, size_t size) {
       break;
 
     case NORMAL:
-      return normal_distr<T>(size);
+      return normal_distr<T>(size, 0, 1, seed);
       break;
 
     case REVERSE_SORTED_UNIFORM:
-      return reverse_sorted_uniform_distr<T>(size);
+      return reverse_sorted_uniform_distr<T>(size, seed);
       break;
 
     case ROOT_DUPS:
@@ -143,7 +202,7 @@ vector<T> generate_data(distr_t data_distr, size_t size) {
       break;
 
     case SORTED_UNIFORM:
-      return sorted_uniform_distr<T>(size);
+      return sorted_uniform_distr<T>(size, seed);
       break;
 
     case TWO_DUPS:
@@ -151,15 +210,15 @@ vector<T> generate_data(distr_t data_distr, size_t size) {
       break;
 
     case UNIFORM:
-      return uniform_distr<T>(size);
+      return uniform_distr<T>(size, 0, -1, seed);
       break;
 
     case ZIPF:
-      return zipf_distr<T>(size);
+      return zipf_distr<T>(size, 0.75, 1e8, seed);
       break;
 
     default:
-      return normal_distr<T>(size);
+      return normal_distr<T>(size, 0, 1, seed);
       break;
   }
 }
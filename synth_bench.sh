@@ -9,4 +9,4 @@ fi
 
 echo -e "\033[34;1mDropping caches...[Ctrl-C to skip]\033[0m"
 sudo sh -c "sync; echo 1 > /proc/sys/vm/drop_caches"
-${EXEC} --benchmark_display_aggregates_only
+${EXEC} --benchmark_display_aggregates_only "$@"
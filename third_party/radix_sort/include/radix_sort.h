@@ -17,23 +17,32 @@
 
 #include <string.h>
 #include <iterator>
+#include <memory>
+#include <type_traits>
 #include <vector>
 
 using namespace std;
 
 // RADIX SORT FLAVORS
-void radix_sort(vector<float>::iterator begin, vector<float>::iterator end);
+void radix_sort(float *begin, float *end);
 
-void radix_sort(vector<double>::iterator begin, vector<double>::iterator end);
+void radix_sort(double *begin, double *end);
 
-void radix_sort(vector<int32_t>::iterator begin, vector<int32_t>::iterator end);
+void radix_sort(int32_t *begin, int32_t *end);
 
-void radix_sort(vector<int64_t>::iterator begin, vector<int64_t>::iterator end);
+void radix_sort(int64_t *begin, int64_t *end);
 
-void radix_sort(vector<uint32_t>::iterator begin,
-                vector<uint32_t>::iterator end);
+void radix_sort(uint32_t *begin, uint32_t *end);
 
-void radix_sort(vector<uint64_t>::iterator begin,
-                vector<uint64_t>::iterator end);
+void radix_sort(uint64_t *begin, uint64_t *end);
+
+// Sorts any contiguous range of the above types in place (e.g., the iterators
+// of std::vector, std::array or std::span), without copying it
+template <class ContiguousIt>
+  requires(std::contiguous_iterator<ContiguousIt> &&
+           !std::is_pointer_v<ContiguousIt>)
+void radix_sort(ContiguousIt begin, ContiguousIt end) {
+  radix_sort(std::to_address(begin), std::to_address(end));
+}
 
 #endif  // RADIX_SORT_H
\ No newline at end of file
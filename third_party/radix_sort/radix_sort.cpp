@@ -40,7 +40,7 @@ static inline uint64_t f8_sort_IFloatFlip(uint64_t u) {
   return (u ^ mask);
 }
 
-void radix_sort(vector<float>::iterator begin, vector<float>::iterator end) {
+void radix_sort(float *begin, float *end) {
   // Tiny test to see if the system is little endian.
   // If not, use std::sort as begin fallback.
   unsigned int i = 1;
@@ -51,7 +51,7 @@ void radix_sort(vector<float>::iterator begin, vector<float>::iterator end) {
     size_t j;
     size_t pos;
     size_t n, sum0 = 0, sum1 = 0, sum2 = 0, tsum = 0;
-    uint32_t *reader, *writer, *buf1 = (uint32_t *)&begin[0], *buf2;
+    uint32_t *reader, *writer, *buf1 = (uint32_t *)begin, *buf2;
     size_t b0[HIST_SIZE * 3], *b1, *b2;
 
     if (sz < HIST_SIZE) return std::sort(begin, end);
@@ -101,7 +101,7 @@ void radix_sort(vector<float>::iterator begin, vector<float>::iterator end) {
       pos = get_byte_2(reader[n]);
       writer[++b2[pos]] = f4_sort_IFloatFlip(reader[n]);
     }
-    memcpy(&begin[0], writer, sz * sizeof(float));
+    memcpy(begin, writer, sz * sizeof(float));
     free(buf2);
 
   } else {  // The system is big endian, so fall back to std::sort
@@ -109,7 +109,7 @@ void radix_sort(vector<float>::iterator begin, vector<float>::iterator end) {
   }
 }
 
-void radix_sort(vector<double>::iterator begin, vector<double>::iterator end) {
+void radix_sort(double *begin, double *end) {
   // Tiny test to see if the system is little endian.
   // If not, use std::sort as a fallback.
   unsigned int i = 1;
@@ -121,7 +121,7 @@ void radix_sort(vector<double>::iterator begin, vector<double>::iterator end) {
     uint64_t pos;
     uint64_t n, sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0, sum4 = 0, sum5 = 0,
               tsum = 0;
-    uint64_t *reader, *writer, *buf1 = (uint64_t *)&begin[0], *buf2;
+    uint64_t *reader, *writer, *buf1 = (uint64_t *)begin, *buf2;
     uint64_t *b0, *b1, *b2, *b3, *b4, *b5;
 
     if (sz < HIST_SIZE) return std::sort(begin, end);
@@ -221,8 +221,7 @@ void radix_sort(vector<double>::iterator begin, vector<double>::iterator end) {
   }
 }
 
-void radix_sort(vector<int32_t>::iterator begin,
-                vector<int32_t>::iterator end) {
+void radix_sort(int32_t *begin, int32_t *end) {
   // Tiny test to see if the system is little endian.
   // If not, use std::sort as a fallback.
   unsigned int i = 1;
@@ -230,7 +229,7 @@ void radix_sort(vector<int32_t>::iterator begin,
 
   if (*is_little_endian) {
     // Start Radix Sort
-    int32_t *const begin_ptr = &*begin;
+    int32_t *const begin_ptr = begin;
     const size_t sz = std::distance(begin, end);
     size_t j;
     int32_t pos;
@@ -299,8 +298,7 @@ void radix_sort(vector<int32_t>::iterator begin,
   }
 }
 
-void radix_sort(vector<int64_t>::iterator begin,
-                vector<int64_t>::iterator end) {
+void radix_sort(int64_t *begin, int64_t *end) {
   // Tiny test to see if the system is little endian.
   // If not, use std::sort as a fallback.
   unsigned int i = 1;
@@ -308,7 +306,7 @@ void radix_sort(vector<int64_t>::iterator begin,
 
   if (*is_little_endian) {
     // Start Radix Sort
-    int64_t *const begin_ptr = &*begin;
+    int64_t *const begin_ptr = begin;
     const size_t sz = std::distance(begin, end);
     uint64_t j;
     size_t pos;
@@ -415,8 +413,7 @@ void radix_sort(vector<int64_t>::iterator begin,
   }
 }
 
-void radix_sort(vector<uint32_t>::iterator begin,
-                vector<uint32_t>::iterator end) {
+void radix_sort(uint32_t *begin, uint32_t *end) {
   // Tiny test to see if the system is little endian.
   // If not, use std::sort as a fallback.
   unsigned int i = 1;
@@ -424,7 +421,7 @@ void radix_sort(vector<uint32_t>::iterator begin,
 
   if (*is_little_endian) {
     // Start Radix Sort
-    uint32_t *const begin_ptr = &*begin;
+    uint32_t *const begin_ptr = begin;
     const size_t sz = std::distance(begin, end);
     size_t pos;
     size_t n, sum0 = 0, sum1 = 0, sum2 = 0, tsum = 0;
@@ -492,8 +489,7 @@ void radix_sort(vector<uint32_t>::iterator begin,
   }
 }
 
-void radix_sort(vector<uint64_t>::iterator begin,
-                vector<uint64_t>::iterator end) {
+void radix_sort(uint64_t *begin, uint64_t *end) {
   // Tiny test to see if the system is little endian.
   // If not, use std::sort as a fallback.
   unsigned int i = 1;
@@ -501,7 +497,7 @@ void radix_sort(vector<uint64_t>::iterator begin,
 
   if (*is_little_endian) {
     // Start Radix Sort
-    uint64_t *const begin_ptr = &*begin;
+    uint64_t *const begin_ptr = begin;
     const size_t sz = std::distance(begin, end);
     size_t j;
     uint64_t pos;
@@ -16,12 +16,15 @@
  */
 
 #include <algorithm>
+#include <memory>
 #include <random>
+#include <span>
 #include <vector>
 
 #include "../include/learned_sort.h"
 #include "../src/utils.h"
 #include "gtest/gtest.h"
+#include "test_resources.h"
 
 using namespace std;
 
@@ -527,3 +530,371 @@ TEST(LEARNED_SORT_TEST, ChiSquaredLong) {
   // Test that it is sorted
   ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
 }
+
+TEST(LEARNED_SORT_TEST, UniformUnsignedFloatInference) {
+  // Generate random input
+  auto arr = uniform_distr<unsigned>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Train the CDF model in double precision and convert it to single precision
+  TwoLayerRMI<unsigned>::Params p;
+  TwoLayerRMI<unsigned> rmi(p);
+  ASSERT_TRUE(rmi.train(arr.begin(), arr.end()));
+  TwoLayerRMI<unsigned, float> float_rmi(rmi);
+
+  // Sort
+  learned_sort::sort(arr.begin(), arr.end(), float_rmi);
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+}
+
+TEST(LEARNED_SORT_TEST, NormalDoubleHugePages) {
+  // Generate random input
+  auto arr = normal_distr<double>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort, allocating the internal buffers from huge pages
+  learned_sort::utils::huge_page_resource huge_pages(true);
+  auto prev = learned_sort::utils::set_scratch_resource(&huge_pages);
+  learned_sort::sort(arr.begin(), arr.end());
+  learned_sort::utils::set_scratch_resource(prev);
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+}
+
+TEST(LEARNED_SORT_TEST, UniformUnsignedMemoryResource) {
+  // Generate random input
+  auto arr = uniform_distr<unsigned>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort, making any allocation that does not go through the given resource
+  // fail
+  counting_resource resource;
+  {
+    null_default_resources null_resources;
+    learned_sort::sort(arr.begin(), arr.end(), &resource);
+  }
+
+  // Test that the memory was allocated from the resource, and released
+  ASSERT_GT(resource.allocated, 0);
+  ASSERT_EQ(resource.allocated, resource.deallocated);
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+}
+
+TEST(LEARNED_SORT_TEST, LognormalDoubleTotalOrder) {
+  // Generate random input with signed zeros, infinities and NaNs
+  auto arr = lognormal_distr<double>(TEST_SIZE);
+  for (size_t i = 0; i < arr.size(); i += 2) arr[i] = -arr[i];
+  const double specials[] = {0.,
+                             -0.,
+                             std::numeric_limits<double>::infinity(),
+                             -std::numeric_limits<double>::infinity(),
+                             std::numeric_limits<double>::quiet_NaN(),
+                             -std::numeric_limits<double>::quiet_NaN()};
+  for (size_t i = 0; i < std::size(specials); ++i) {
+    arr[i * arr.size() / std::size(specials)] = specials[i];
+  }
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort
+  learned_sort::sort_total_order(arr.begin(), arr.end());
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted in the total order
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end(), [](double a, double b) {
+    return learned_sort::utils::float_flip(a) <
+           learned_sort::utils::float_flip(b);
+  }));
+  ASSERT_TRUE(std::isnan(arr.front()) && std::signbit(arr.front()));
+  ASSERT_TRUE(std::isnan(arr.back()) && !std::signbit(arr.back()));
+}
+
+TEST(LEARNED_SORT_TEST, ExponentialFloatTotalOrder) {
+  // Generate random input
+  auto arr = exponential_distr<float>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort
+  learned_sort::sort_total_order(arr.begin(), arr.end());
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+}
+
+TEST(LEARNED_SORT_TEST, NormalDoubleDescending) {
+  // Generate random input
+  auto arr = normal_distr<double>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort
+  learned_sort::sort<learned_sort::order::descending>(arr.begin(), arr.end());
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted in descending order
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end(), std::greater<>()));
+}
+
+TEST(LEARNED_SORT_TEST, RootDupsUnsignedDescending) {
+  // Generate random input
+  auto arr = root_dups_distr<unsigned>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort
+  learned_sort::sort<learned_sort::order::descending>(arr.begin(), arr.end());
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted in descending order
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end(), std::greater<>()));
+}
+
+TEST(LEARNED_SORT_TEST, SortedDoubleDescending) {
+  // Generate input sorted in the opposite order
+  auto arr = sorted_uniform_distr<double>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort
+  learned_sort::sort<learned_sort::order::descending>(arr.begin(), arr.end());
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted in descending order
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end(), std::greater<>()));
+}
+
+TEST(LEARNED_SORT_TEST, LognormalDoubleTotalOrderDescending) {
+  // Generate random input with signed zeros, infinities and NaNs
+  auto arr = lognormal_distr<double>(TEST_SIZE);
+  for (size_t i = 0; i < arr.size(); i += 2) arr[i] = -arr[i];
+  arr[0] = -std::numeric_limits<double>::quiet_NaN();
+  arr[1] = std::numeric_limits<double>::infinity();
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort
+  learned_sort::sort_total_order<learned_sort::order::descending>(arr.begin(),
+                                                                  arr.end());
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted in the reverse of the total order
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end(), [](double a, double b) {
+    return learned_sort::utils::float_flip(a) >
+           learned_sort::utils::float_flip(b);
+  }));
+  ASSERT_TRUE(std::isinf(arr.front()));
+  ASSERT_TRUE(std::isnan(arr.back()));
+}
+
+TEST(LEARNED_SORT_TEST, ConcatenatedRunsDouble) {
+  // Generate input that consists of a few sorted runs
+  auto arr = normal_distr<double>(TEST_SIZE);
+  const size_t num_runs = 5;
+  for (size_t r = 0; r < num_runs; ++r) {
+    std::sort(arr.begin() + r * arr.size() / num_runs,
+              arr.begin() + (r + 1) * arr.size() / num_runs);
+  }
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort
+  learned_sort::sort(arr.begin(), arr.end());
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+}
+
+TEST(LEARNED_SORT_TEST, LateArrivalsUnsignedDescending) {
+  // Generate sorted input, in which a few keys arrived late
+  auto arr = sorted_uniform_distr<unsigned>(TEST_SIZE);
+  std::reverse(arr.begin(), arr.end());
+  for (size_t i = 1; i < 8; ++i) {
+    std::swap(arr[i * arr.size() / 8], arr[i * arr.size() / 8 - i * 100]);
+  }
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort
+  learned_sort::sort<learned_sort::order::descending>(arr.begin(), arr.end());
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted in descending order
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end(), std::greater<>()));
+}
+
+TEST(LEARNED_SORT_TEST, RoundedNormalDoubleUnique) {
+  // Generate random input with many duplicates
+  auto arr = normal_distr<double>(TEST_SIZE);
+  for (auto &key : arr) key = std::round(key * 1000);
+
+  // Compute the expected output
+  auto expected = arr;
+  std::sort(expected.begin(), expected.end());
+  expected.erase(std::unique(expected.begin(), expected.end()),
+                 expected.end());
+
+  // Sort and remove the duplicates
+  auto unique_end = learned_sort::sort_unique(arr.begin(), arr.end());
+  arr.erase(unique_end, arr.end());
+
+  // Test that exactly the distinct keys are left, in sorted order
+  ASSERT_EQ(expected, arr);
+}
+
+TEST(LEARNED_SORT_TEST, UniformUnsignedCountDistinct) {
+  // Generate random input with a known number of distinct keys
+  std::vector<unsigned> arr;
+  std::mt19937_64 prng(1604922353);
+  for (size_t i = 0; i < TEST_SIZE; ++i) {
+    arr.emplace_back(i % 5000 * 7);
+  }
+  std::shuffle(arr.begin(), arr.end(), prng);
+
+  // Test that the distinct keys are counted, and left in strictly ascending
+  // order
+  ASSERT_EQ(5000, learned_sort::count_distinct(arr.begin(), arr.end()));
+  ASSERT_TRUE(std::adjacent_find(arr.begin(), arr.begin() + 5000,
+                                 std::greater_equal<>()) == arr.begin() + 5000);
+}
+
+TEST(LEARNED_SORT_TEST, NormalDoubleRawPointer) {
+  // Generate random input, and copy it to a buffer that is not a vector
+  auto arr = normal_distr<double>(TEST_SIZE);
+  auto cksm = get_checksum(arr);
+  std::unique_ptr<double[]> buf(new double[arr.size()]);
+  std::copy(arr.begin(), arr.end(), buf.get());
+
+  // Sort the buffer in place, through raw pointers
+  learned_sort::sort(buf.get(), buf.get() + arr.size());
+  std::copy(buf.get(), buf.get() + arr.size(), arr.begin());
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+}
+
+TEST(LEARNED_SORT_TEST, UniformUnsignedSpan) {
+  // Generate random input
+  auto arr = uniform_distr<unsigned>(TEST_SIZE);
+  const auto orig = arr;
+
+  // Sort the middle half of the input through a span over it
+  const size_t span_start = arr.size() / 4;
+  const size_t span_end = span_start + arr.size() / 2;
+  std::span<unsigned> middle(arr.data() + span_start, span_end - span_start);
+  learned_sort::sort(middle.begin(), middle.end());
+
+  // Test that the keys outside of the span were not touched
+  ASSERT_TRUE(std::equal(arr.begin(), arr.begin() + span_start, orig.begin()));
+  ASSERT_TRUE(
+      std::equal(arr.begin() + span_end, arr.end(), orig.begin() + span_end));
+
+  // Test that the span holds the same keys, sorted
+  vector<unsigned> expected(orig.begin() + span_start,
+                            orig.begin() + span_end);
+  std::sort(expected.begin(), expected.end());
+  ASSERT_TRUE(std::equal(middle.begin(), middle.end(), expected.begin()));
+}
+
+TEST(LEARNED_SORT_TEST, NormalDoubleRefit) {
+  // Generate random input, and sort a copy of it, keeping the CDF model
+  auto arr = normal_distr<double>(TEST_SIZE);
+  TwoLayerRMI<double>::Params p;
+  TwoLayerRMI<double> rmi(p);
+  auto sorted = arr;
+  learned_sort::sort(sorted.begin(), sorted.end(), p,
+                     learned_sort::utils::scratch_resource(), &rmi);
+
+  // Test that no leaf model is refit while the keys are unchanged
+  ASSERT_EQ(0, rmi.refit(arr.begin(), arr.end()));
+
+  // Move 5% of the keys into a narrow cluster
+  std::mt19937_64 prng(1604922353);
+  std::normal_distribution<double> cluster(.5, .01);
+  for (size_t i = 0; i < arr.size() / 20; ++i) {
+    arr[prng() % arr.size()] = cluster(prng);
+  }
+
+  // Count the keys that the stale model predicts to its fullest bucket
+  vector<long> stale_fill(PRIMARY_FANOUT, 0);
+  for (double key : arr) {
+    ++stale_fill[static_cast<long>(std::max<double>(
+        0, std::min<double>(PRIMARY_FANOUT - 1,
+                            rmi.predict(key) * PRIMARY_FANOUT)))];
+  }
+  const long stale_max_fill =
+      *std::max_element(stale_fill.begin(), stale_fill.end());
+
+  // Refit the model, and test that only a few leaf models were refit
+  const long num_refit = rmi.refit(arr.begin(), arr.end());
+  ASSERT_GT(num_refit, 0);
+  ASSERT_LT(num_refit, p.num_leaf_models / 10);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort with the refit model
+  learned_sort::sort(arr.begin(), arr.end(), rmi);
+
+  // Test that the fullest bucket holds less than half of the keys that the
+  // stale model would have put in it
+  ASSERT_EQ(PRIMARY_FANOUT, rmi.bucket_fill.size());
+  ASSERT_LT(2 * *std::max_element(rmi.bucket_fill.begin(),
+                                  rmi.bucket_fill.end()),
+            stale_max_fill);
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+}
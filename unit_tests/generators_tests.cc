@@ -0,0 +1,71 @@
+/**
+ * @file generators_tests.cc
+ * @brief Unit tests for the synthetic data generators
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo (anikristo@gmail.com)
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "../src/utils.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+extern size_t TEST_SIZE;
+
+TEST(GENERATORS_TEST, ReproducibleAcrossThreadCounts) {
+  const size_t default_threads = generator_threads();
+
+  for (auto distr : {MIX_GAUSS, NORMAL, SORTED_UNIFORM, ZIPF}) {
+    // Generate the same input with one and with several threads
+    generator_threads() = 1;
+    auto serial = generate_data<double>(distr, TEST_SIZE);
+    generator_threads() = 4;
+    auto parallel = generate_data<double>(distr, TEST_SIZE);
+
+    // Test that they are identical
+    ASSERT_EQ(serial, parallel);
+  }
+
+  generator_threads() = default_threads;
+}
+
+TEST(GENERATORS_TEST, SeededZipf) {
+  const size_t cardinality = 1000;
+  auto arr = zipf_distr<unsigned>(TEST_SIZE, 0.75, cardinality, 1);
+
+  // Test that the same seed generates the same input, and a different one
+  // does not
+  ASSERT_EQ(arr, zipf_distr<unsigned>(TEST_SIZE, 0.75, cardinality, 1));
+  ASSERT_NE(arr, zipf_distr<unsigned>(TEST_SIZE, 0.75, cardinality, 2));
+
+  // Test that the keys are in range, and that the smallest key is the most
+  // frequent one
+  ASSERT_EQ(*std::min_element(arr.begin(), arr.end()), 1);
+  ASSERT_LE(*std::max_element(arr.begin(), arr.end()), cardinality);
+  ASSERT_GT(std::count(arr.begin(), arr.end(), 1),
+            std::count(arr.begin(), arr.end(), 2));
+}
+
+TEST(GENERATORS_TEST, SortedUniform) {
+  auto arr = sorted_uniform_distr<double>(TEST_SIZE);
+
+  // Test that the input is sorted and spans the range of uniform_distr
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+  ASSERT_GE(arr.front(), -1. * TEST_SIZE);
+  ASSERT_LT(arr.back(), 1. * TEST_SIZE);
+  ASSERT_LT(arr.front(), -0.99 * TEST_SIZE);
+  ASSERT_GT(arr.back(), 0.99 * TEST_SIZE);
+}
@@ -0,0 +1,147 @@
+/**
+ * @file learned_aggregate_tests.cc
+ * @brief Unit tests for the aggregations that are driven by the CDF model
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo (anikristo@gmail.com)
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+#include "../include/learned_aggregate.h"
+#include "../src/utils.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+extern size_t TEST_SIZE;
+
+TEST(LEARNED_AGGREGATE_TEST, LognormalDoubleHistogram) {
+  // Generate random input
+  auto arr = lognormal_distr<double>(TEST_SIZE);
+  const auto orig = arr;
+
+  // Build the histogram
+  const long NUM_BINS = 64;
+  auto bins = learned_sort::equi_depth_histogram(arr.begin(), arr.end(),
+                                                 NUM_BINS);
+
+  // Test that the input is untouched
+  ASSERT_EQ(orig, arr);
+
+  // Test that every key is counted once, and that the bins are about equally
+  // deep and ordered
+  ASSERT_LE(bins.size(), NUM_BINS);
+  ASSERT_GE(bins.size(), NUM_BINS / 2);
+  long num_counted = 0;
+  for (size_t i = 0; i < bins.size(); ++i) {
+    ASSERT_LE(bins[i].min_key, bins[i].max_key);
+    ASSERT_LE(bins[i].count, 2 * arr.size() / NUM_BINS);
+    num_counted += bins[i].count;
+  }
+  ASSERT_EQ(arr.size(), num_counted);
+  ASSERT_EQ(*std::min_element(arr.begin(), arr.end()), bins.front().min_key);
+  ASSERT_EQ(*std::max_element(arr.begin(), arr.end()), bins.back().max_key);
+
+  // Test that each bin holds the keys in its range, up to the overlaps with
+  // its neighbors that a non-monotonic model can cause
+  std::sort(arr.begin(), arr.end());
+  for (const auto &bin : bins) {
+    const long in_range =
+        std::upper_bound(arr.begin(), arr.end(), bin.max_key) -
+        std::lower_bound(arr.begin(), arr.end(), bin.min_key);
+    ASSERT_GE(in_range, bin.count);
+    ASSERT_LE(in_range, bin.count + arr.size() / 1000);
+  }
+}
+
+TEST(LEARNED_AGGREGATE_TEST, SmallUnsignedHistogram) {
+  // Generate an input that is too small to train a model on
+  auto arr = uniform_distr<unsigned>(1000);
+
+  // Build the histogram
+  auto bins = learned_sort::equi_depth_histogram(arr.begin(), arr.end(), 8);
+
+  // Test that the bins are exactly equally deep
+  std::sort(arr.begin(), arr.end());
+  ASSERT_EQ(8, bins.size());
+  for (size_t i = 0; i < bins.size(); ++i) {
+    ASSERT_EQ(125, bins[i].count);
+    ASSERT_EQ(arr[i * 125], bins[i].min_key);
+    ASSERT_EQ(arr[i * 125 + 124], bins[i].max_key);
+  }
+}
+
+TEST(LEARNED_AGGREGATE_TEST, ZipfUnsignedCountByKey) {
+  // Generate random input
+  auto arr = zipf_distr<unsigned>(TEST_SIZE, 0.75, 1e5);
+  const auto orig = arr;
+
+  // Count the occurrences of each key
+  auto counts = learned_sort::count_by_key(arr.begin(), arr.end());
+
+  // Test that the input is untouched
+  ASSERT_EQ(orig, arr);
+
+  // Test that the counts match
+  map<unsigned, long> expected;
+  for (auto key : arr) ++expected[key];
+  ASSERT_EQ(expected.size(), counts.size());
+  auto it = expected.begin();
+  for (const auto &[key, count] : counts) {
+    ASSERT_EQ(it->first, key);
+    ASSERT_EQ(it->second, count);
+    ++it;
+  }
+}
+
+TEST(LEARNED_AGGREGATE_TEST, RoundedNormalDoubleSumByKey) {
+  // Generate random input with many duplicates, and a payload for each key
+  auto arr = normal_distr<double>(TEST_SIZE);
+  for (auto &key : arr) key = std::round(key * 10000);
+  vector<long> payload(arr.size());
+  for (size_t i = 0; i < payload.size(); ++i) payload[i] = i % 7;
+
+  // Sum the payloads of each key
+  auto sums =
+      learned_sort::sum_by_key(arr.begin(), arr.end(), payload.begin());
+
+  // Test that the sums match
+  map<double, long> expected;
+  for (size_t i = 0; i < arr.size(); ++i) expected[arr[i]] += payload[i];
+  ASSERT_EQ(expected.size(), sums.size());
+  auto it = expected.begin();
+  for (const auto &[key, sum] : sums) {
+    ASSERT_EQ(it->first, key);
+    ASSERT_EQ(it->second, sum);
+    ++it;
+  }
+}
+
+TEST(LEARNED_AGGREGATE_TEST, ModuloUnsignedCountByKey) {
+  // Generate an input with too few distinct keys to train a model on
+  auto arr = modulo_distr<unsigned>(TEST_SIZE, 100);
+
+  // Count the occurrences of each key
+  auto counts = learned_sort::count_by_key(arr.begin(), arr.end());
+
+  // Test that the counts match
+  ASSERT_EQ(100, counts.size());
+  for (size_t i = 0; i < counts.size(); ++i) {
+    ASSERT_EQ(i, counts[i].first);
+    ASSERT_EQ((arr.size() + 99 - i) / 100, counts[i].second);
+  }
+}
@@ -0,0 +1,124 @@
+/**
+ * @file learned_index_tests.cc
+ * @brief Unit tests for the learned index that is built while sorting
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo (anikristo@gmail.com)
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "../include/learned_index.h"
+#include "../src/utils.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+extern size_t TEST_SIZE;
+
+TEST(LEARNED_INDEX_TEST, LognormalDoubleLowerBound) {
+  // Generate random input, and probes that are mostly not in it
+  auto arr = lognormal_distr<double>(TEST_SIZE);
+  auto probes = lognormal_distr<double>(TEST_SIZE / 10, 0, 0.5, 0, 42);
+  probes.insert(probes.end(), arr.begin(), arr.begin() + TEST_SIZE / 10);
+  probes.push_back(-1);
+  probes.push_back(1e9);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort the data and index it
+  auto index = learned_sort::sort_with_index(arr.begin(), arr.end());
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+
+  // Test that the searches are bounded, and that they match std::lower_bound
+  ASSERT_LT(index.max_search_window(), arr.size() / 100);
+  for (auto probe : probes) {
+    ASSERT_EQ(std::lower_bound(arr.begin(), arr.end(), probe),
+              index.lower_bound(probe));
+  }
+}
+
+TEST(LEARNED_INDEX_TEST, RootDupsUnsignedLowerBound) {
+  // Generate random input
+  auto arr = root_dups_distr<unsigned>(TEST_SIZE);
+
+  // Sort the data and index it
+  auto index = learned_sort::sort_with_index(arr.begin(), arr.end());
+
+  // Test that every key is found at the first of its copies
+  for (unsigned probe = 0; probe <= arr.back() + 1; ++probe) {
+    ASSERT_EQ(std::lower_bound(arr.begin(), arr.end(), probe),
+              index.lower_bound(probe));
+  }
+}
+
+TEST(LEARNED_INDEX_TEST, SortedDoubleLowerBound) {
+  // Generate a sorted input, which is not sorted with a model
+  auto arr = sorted_uniform_distr<double>(TEST_SIZE);
+  auto probes = uniform_distr<double>(TEST_SIZE / 10, -1. * TEST_SIZE,
+                                      1. * TEST_SIZE, 42);
+
+  // Sort the data and index it, which trains a model on the sorted keys
+  auto index = learned_sort::sort_with_index(arr.begin(), arr.end());
+
+  // Test that the searches match std::lower_bound
+  for (auto probe : probes) {
+    ASSERT_EQ(std::lower_bound(arr.begin(), arr.end(), probe),
+              index.lower_bound(probe));
+  }
+}
+
+TEST(LEARNED_INDEX_TEST, NormalDoubleLookupBatch) {
+  // Generate random input, and probes that are mostly not in it
+  auto arr = normal_distr<double>(TEST_SIZE);
+  auto probes = normal_distr<double>(TEST_SIZE / 10, 0, 1.5, 42);
+  probes.insert(probes.end(), arr.begin(), arr.begin() + TEST_SIZE / 10);
+
+  // Sort the data and index it
+  auto index = learned_sort::sort_with_index(arr.begin(), arr.end());
+
+  // Test that the batched searches match std::lower_bound, both for unsorted
+  // and for sorted probes
+  for (int sorted = 0; sorted < 2; ++sorted) {
+    if (sorted) std::sort(probes.begin(), probes.end());
+
+    vector<long> positions(probes.size());
+    index.lookup_batch(probes.begin(), probes.end(), positions.begin());
+    for (size_t i = 0; i < probes.size(); ++i) {
+      ASSERT_EQ(std::lower_bound(arr.begin(), arr.end(), probes[i]) -
+                    arr.begin(),
+                positions[i]);
+    }
+  }
+}
+
+TEST(LEARNED_INDEX_TEST, RootDupsUnsignedEqualRange) {
+  // Generate random input
+  auto arr = root_dups_distr<unsigned>(TEST_SIZE);
+
+  // Sort the data and index it
+  auto index = learned_sort::sort_with_index(arr.begin(), arr.end());
+
+  // Test that the ranges of equal keys match std::equal_range
+  for (unsigned probe = 0; probe <= arr.back() + 1; ++probe) {
+    ASSERT_EQ(std::equal_range(arr.begin(), arr.end(), probe),
+              index.equal_range(probe));
+  }
+}
@@ -0,0 +1,142 @@
+/**
+ * @file learned_join_tests.cc
+ * @brief Unit tests for the equi-join that partitions with a CDF model
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo (anikristo@gmail.com)
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#include "../include/learned_join.h"
+#include "../src/utils.h"
+#include "gtest/gtest.h"
+#include "test_resources.h"
+
+using namespace std;
+
+extern size_t TEST_SIZE;
+
+// Joins the two inputs by sorting them along with their offsets
+template <class T>
+vector<pair<long, long>> sort_merge_join(const vector<T> &left,
+                                         const vector<T> &right) {
+  vector<pair<T, long>> l, r;
+  for (size_t i = 0; i < left.size(); ++i) l.emplace_back(left[i], i);
+  for (size_t i = 0; i < right.size(); ++i) r.emplace_back(right[i], i);
+  std::sort(l.begin(), l.end());
+  std::sort(r.begin(), r.end());
+
+  vector<pair<long, long>> matches;
+  for (size_t i = 0, j = 0; i < l.size() && j < r.size();) {
+    if (l[i].first < r[j].first) {
+      ++i;
+    } else if (r[j].first < l[i].first) {
+      ++j;
+    } else {
+      size_t j_end = j;
+      while (j_end < r.size() && r[j_end].first == l[i].first) ++j_end;
+      for (; i < l.size() && l[i].first == r[j].first; ++i) {
+        for (size_t k = j; k < j_end; ++k) {
+          matches.emplace_back(l[i].second, r[k].second);
+        }
+      }
+      j = j_end;
+    }
+  }
+  return matches;
+}
+
+TEST(LEARNED_JOIN_TEST, UniformUnsignedJoin) {
+  // Generate random inputs, with a few matches for every key
+  auto left = uniform_distr<unsigned>(TEST_SIZE, 0, TEST_SIZE / 4);
+  auto right = uniform_distr<unsigned>(TEST_SIZE / 2, 0, TEST_SIZE / 4, 42);
+  const auto orig_left = left;
+
+  // Join them on more threads than there are cores
+  auto matches = learned_sort::join(left.begin(), left.end(), right.begin(),
+                                    right.end(),
+                                    learned_sort::utils::scratch_resource(), 8);
+
+  // Test that the inputs are untouched
+  ASSERT_EQ(orig_left, left);
+
+  // Test that the matches of every left key are adjacent and in order
+  for (size_t i = 1; i < matches.size(); ++i) {
+    if (matches[i].first == matches[i - 1].first) {
+      ASSERT_LT(matches[i - 1].second, matches[i].second);
+    }
+  }
+
+  // Test that the same matches are found as with a sort-merge join
+  auto expected = sort_merge_join(left, right);
+  std::sort(matches.begin(), matches.end());
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(expected, matches);
+}
+
+TEST(LEARNED_JOIN_TEST, LognormalDoubleSelfJoin) {
+  // Generate random input
+  auto arr = lognormal_distr<double>(TEST_SIZE);
+
+  // Join it with itself
+  auto matches =
+      learned_sort::join(arr.begin(), arr.end(), arr.begin(), arr.end());
+
+  // Test that the same matches are found as with a sort-merge join
+  auto expected = sort_merge_join(arr, arr);
+  std::sort(matches.begin(), matches.end());
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(expected, matches);
+}
+
+TEST(LEARNED_JOIN_TEST, ModuloUnsignedJoin) {
+  // Generate inputs with too few distinct keys to train a model on
+  auto left = modulo_distr<unsigned>(2000, 10);
+  auto right = modulo_distr<unsigned>(1000, 10);
+
+  // Join them
+  auto matches = learned_sort::join(left.begin(), left.end(), right.begin(),
+                                    right.end());
+
+  // Test that the same matches are found as with a sort-merge join
+  auto expected = sort_merge_join(left, right);
+  std::sort(matches.begin(), matches.end());
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(expected, matches);
+}
+
+TEST(LEARNED_JOIN_TEST, UniformUnsignedMemoryResource) {
+  // Generate random inputs, with a few matches for every key
+  auto left = uniform_distr<unsigned>(TEST_SIZE, 0, TEST_SIZE / 4);
+  auto right = uniform_distr<unsigned>(TEST_SIZE / 2, 0, TEST_SIZE / 4, 42);
+
+  // Join them on several threads, making any auxiliary allocation that does
+  // not go through the given resource fail
+  std::pmr::synchronized_pool_resource resource;
+  vector<pair<long, long>> matches;
+  {
+    null_default_resources null_resources;
+    matches = learned_sort::join(left.begin(), left.end(), right.begin(),
+                                 right.end(), &resource, 4);
+  }
+
+  // Test that the same matches are found as with a sort-merge join
+  auto expected = sort_merge_join(left, right);
+  std::sort(matches.begin(), matches.end());
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(expected, matches);
+}
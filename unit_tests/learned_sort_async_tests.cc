@@ -0,0 +1,123 @@
+/**
+ * @file learned_sort_async_tests.cc
+ * @brief Unit tests for the sort that runs in steps as a coroutine
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo (anikristo@gmail.com)
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "../include/learned_sort_async.h"
+#include "../src/utils.h"
+#include "gtest/gtest.h"
+#include "test_resources.h"
+
+using namespace std;
+
+extern size_t TEST_SIZE;
+
+TEST(LEARNED_SORT_ASYNC_TEST, NormalDoubleSteps) {
+  // Generate random input
+  auto arr = normal_distr<double>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort one step at a time, and test that the progress never goes back
+  auto task = learned_sort::sort_async(arr.begin(), arr.end());
+  ASSERT_EQ(learned_sort::sort_phase::training, task.phase());
+  double prev_progress = 0;
+  while (task.resume()) {
+    ASSERT_NE(learned_sort::sort_phase::done, task.phase());
+    ASSERT_GE(task.progress(), prev_progress);
+    ASSERT_LT(task.progress(), 1);
+    prev_progress = task.progress();
+  }
+  ASSERT_TRUE(task.done());
+  ASSERT_EQ(learned_sort::sort_phase::done, task.phase());
+  ASSERT_EQ(1, task.progress());
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+}
+
+TEST(LEARNED_SORT_ASYNC_TEST, UniformUnsignedCancel) {
+  // Generate random input
+  auto arr = uniform_distr<unsigned>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort until the first group of buckets is sorted, and then cancel
+  auto task = learned_sort::sort_async(arr.begin(), arr.end());
+  while (task.resume() && task.progress() == 0) {
+  }
+  task.cancel();
+  ASSERT_TRUE(task.done());
+  ASSERT_FALSE(task.resume());
+  ASSERT_EQ(learned_sort::sort_phase::cancelled, task.phase());
+
+  // Test that the input still holds all of its keys
+  ASSERT_EQ(cksm, get_checksum(arr));
+}
+
+TEST(LEARNED_SORT_ASYNC_TEST, LognormalDoubleDescendingRun) {
+  // Generate random input
+  auto arr = lognormal_distr<double>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort
+  learned_sort::sort_async<learned_sort::order::descending>(arr.begin(),
+                                                            arr.end())
+      .run();
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end(), std::greater<>()));
+}
+
+TEST(LEARNED_SORT_ASYNC_TEST, NormalDoubleMemoryResource) {
+  // Generate random input
+  auto arr = normal_distr<double>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort, making any allocation that does not go through the given resource
+  // fail
+  counting_resource resource;
+  {
+    null_default_resources null_resources;
+    learned_sort::sort_async(arr.begin(), arr.end(), &resource).run();
+  }
+
+  // Test that the memory was allocated from the resource, and released
+  ASSERT_GT(resource.allocated, 0);
+  ASSERT_EQ(resource.allocated, resource.deallocated);
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+}
@@ -0,0 +1,110 @@
+/**
+ * @file learned_sort_columns_tests.cc
+ * @brief Unit tests for sorting the rows of a table that is stored as columns
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo (anikristo@gmail.com)
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <tuple>
+#include <vector>
+
+#include "../include/learned_sort_columns.h"
+#include "../src/utils.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+extern size_t TEST_SIZE;
+
+TEST(LEARNED_SORT_COLUMNS_TEST, UniformUnsignedDateId) {
+  // Generate a table with few distinct dates, and random ids
+  auto dates = uniform_distr<unsigned>(TEST_SIZE, 0, 3650);
+  auto ids = uniform_distr<unsigned long>(TEST_SIZE, 0, 1e18, 42);
+  const auto orig_dates = dates;
+  const auto orig_ids = ids;
+
+  // Find the permutation that sorts the rows
+  auto perm =
+      learned_sort::sort_permutation(dates.begin(), dates.end(), ids.begin());
+
+  // Test that the columns are untouched
+  ASSERT_EQ(orig_dates, dates);
+  ASSERT_EQ(orig_ids, ids);
+
+  // Test that it is the permutation of a stable sort of the rows
+  vector<long> expected(TEST_SIZE);
+  std::iota(expected.begin(), expected.end(), 0L);
+  std::stable_sort(expected.begin(), expected.end(), [&](long a, long b) {
+    return std::tie(dates[a], ids[a]) < std::tie(dates[b], ids[b]);
+  });
+  ASSERT_EQ(expected, perm);
+}
+
+TEST(LEARNED_SORT_COLUMNS_TEST, NormalDoubleRegionDescending) {
+  // Generate a table of rounded timestamps with duplicates, few regions, and
+  // a third column that breaks some of the remaining ties
+  auto timestamps = normal_distr<double>(TEST_SIZE, 1e9, 1e7);
+  for (auto &ts : timestamps) ts = std::round(ts / 100);
+  auto regions = uniform_distr<unsigned>(TEST_SIZE, 0, 50, 42);
+  auto tags = uniform_distr<long>(TEST_SIZE, 0, 4, 43);
+
+  // Calculate the checksums
+  auto cksm_timestamps = get_checksum(timestamps);
+  auto cksm_regions = get_checksum(regions);
+  auto cksm_tags = get_checksum(tags);
+
+  // Sort the rows by region, timestamp and tag, in descending order
+  learned_sort::sort_columns<learned_sort::order::descending>(
+      regions.begin(), regions.end(), timestamps.begin(), tags.begin());
+
+  // Test that the checksums are the same
+  ASSERT_EQ(cksm_timestamps, get_checksum(timestamps));
+  ASSERT_EQ(cksm_regions, get_checksum(regions));
+  ASSERT_EQ(cksm_tags, get_checksum(tags));
+
+  // Test that the rows are sorted in descending order
+  for (size_t i = 1; i < TEST_SIZE; ++i) {
+    ASSERT_GE(std::tie(regions[i - 1], timestamps[i - 1], tags[i - 1]),
+              std::tie(regions[i], timestamps[i], tags[i]));
+  }
+}
+
+TEST(LEARNED_SORT_COLUMNS_TEST, UniformLongPayload) {
+  // Generate a table whose keys have a few copies each, and a payload column
+  // that is not a sort key
+  auto keys = uniform_distr<long>(TEST_SIZE, 0, TEST_SIZE / 4);
+  vector<long> payloads(TEST_SIZE);
+  std::iota(payloads.begin(), payloads.end(), 0L);
+
+  // Sort the keys, and permute the payloads along with them
+  auto perm = learned_sort::sort_permutation(keys.begin(), keys.end());
+  vector<long> sorted_keys, sorted_payloads;
+  for (long row : perm) {
+    sorted_keys.push_back(keys[row]);
+    sorted_payloads.push_back(payloads[row]);
+  }
+
+  // Test that the keys are sorted, and that the copies of a key keep the
+  // order of their payloads
+  ASSERT_TRUE(std::is_sorted(sorted_keys.begin(), sorted_keys.end()));
+  for (size_t i = 1; i < TEST_SIZE; ++i) {
+    if (sorted_keys[i - 1] == sorted_keys[i]) {
+      ASSERT_LT(sorted_payloads[i - 1], sorted_payloads[i]);
+    }
+  }
+}
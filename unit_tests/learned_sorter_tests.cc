@@ -0,0 +1,84 @@
+/**
+ * @file learned_sorter_tests.cc
+ * @brief Unit tests for the streaming interface of Learned Sort
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo (anikristo@gmail.com)
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "../include/learned_sorter.h"
+#include "../src/utils.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+extern size_t TEST_SIZE;
+
+TEST(LEARNED_SORTER_TEST, NormalDoubleRuns) {
+  // Generate random input
+  auto arr = normal_distr<double>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Stream the input in chunks and collect the runs
+  const long RUN_SZ = TEST_SIZE / 3 + 1;
+  const long CHUNK_SZ = 100'000;
+  vector<double> output;
+  long num_runs = 0;
+  learned_sort::LearnedSorter<double> sorter(RUN_SZ, [&](vector<double> &run) {
+    // Test that every run is sorted and complete
+    ASSERT_TRUE(std::is_sorted(run.begin(), run.end()));
+    ASSERT_TRUE(static_cast<long>(run.size()) == RUN_SZ ||
+                output.size() + run.size() == TEST_SIZE);
+    output.insert(output.end(), run.begin(), run.end());
+    ++num_runs;
+  });
+  for (size_t i = 0; i < TEST_SIZE; i += CHUNK_SZ) {
+    sorter.push(arr.begin() + i,
+                arr.begin() + std::min<size_t>(i + CHUNK_SZ, TEST_SIZE));
+  }
+  sorter.finish();
+
+  // Test that the model was used
+  ASSERT_TRUE(sorter.is_model_trained());
+
+  // Test that all the keys were emitted
+  ASSERT_EQ(num_runs, (TEST_SIZE + RUN_SZ - 1) / RUN_SZ);
+  ASSERT_EQ(cksm, get_checksum(output));
+}
+
+TEST(LEARNED_SORTER_TEST, IdenticalUnsignedRuns) {
+  // Generate random input
+  auto arr = identical_distr<unsigned>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Stream the input in a single chunk and collect the runs
+  vector<unsigned> output;
+  learned_sort::LearnedSorter<unsigned> sorter(
+      TEST_SIZE / 2, [&](vector<unsigned> &run) {
+        ASSERT_TRUE(std::is_sorted(run.begin(), run.end()));
+        output.insert(output.end(), run.begin(), run.end());
+      });
+  sorter.push(arr);
+  sorter.finish();
+
+  // Test that all the keys were emitted
+  ASSERT_EQ(cksm, get_checksum(output));
+}
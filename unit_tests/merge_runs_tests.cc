@@ -0,0 +1,102 @@
+/**
+ * @file merge_runs_tests.cc
+ * @brief Unit tests for the model-guided merge of sorted runs
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo (anikristo@gmail.com)
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "../include/learned_sort.h"
+#include "../src/utils.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+extern size_t TEST_SIZE;
+
+TEST(MERGE_RUNS_TEST, NormalDoubleRuns) {
+  // Generate random input
+  auto arr = normal_distr<double>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Split the input into sorted runs
+  const size_t NUM_RUNS = 8;
+  vector<vector<double>> runs;
+  for (size_t r = 0; r < NUM_RUNS; ++r) {
+    runs.emplace_back(arr.begin() + r * arr.size() / NUM_RUNS,
+                      arr.begin() + (r + 1) * arr.size() / NUM_RUNS);
+    learned_sort::sort(runs.back().begin(), runs.back().end());
+  }
+
+  // Merge the runs on more threads than there are runs
+  vector<double> output(arr.size());
+  learned_sort::merge_runs(runs, output.begin(),
+                           learned_sort::utils::scratch_resource(), 16);
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(output));
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(output.begin(), output.end()));
+}
+
+TEST(MERGE_RUNS_TEST, LognormalDoubleUnequalSpansDescending) {
+  // Generate random input
+  auto arr = lognormal_distr<double>(TEST_SIZE);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Split the input into sorted runs of very different sizes, one of which is
+  // empty
+  vector<std::span<double>> runs;
+  size_t run_begin = 0;
+  for (size_t run_end : {arr.size() / 2, arr.size() / 2, arr.size() / 2 + 7,
+                         arr.size() * 4 / 5, arr.size()}) {
+    runs.emplace_back(arr.data() + run_begin, run_end - run_begin);
+    std::sort(runs.back().begin(), runs.back().end(), std::greater<>());
+    run_begin = run_end;
+  }
+
+  // Merge the runs
+  vector<double> output(arr.size());
+  learned_sort::merge_runs<learned_sort::order::descending>(
+      runs, output.begin(), learned_sort::utils::scratch_resource(), 3);
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(output));
+
+  // Test that it is sorted in descending order
+  ASSERT_TRUE(std::is_sorted(output.begin(), output.end(), std::greater<>()));
+}
+
+TEST(MERGE_RUNS_TEST, IdenticalUnsignedRuns) {
+  // Generate input with a single unique key, on which no model can be trained
+  vector<vector<unsigned>> runs(4, vector<unsigned>(TEST_SIZE / 4, 42));
+
+  // Merge the runs
+  vector<unsigned> output(runs.size() * runs[0].size());
+  learned_sort::merge_runs(runs, output.begin(),
+                           learned_sort::utils::scratch_resource(), 4);
+
+  // Test that all the keys were merged
+  ASSERT_TRUE(std::all_of(output.begin(), output.end(),
+                          [](unsigned key) { return key == 42; }));
+}
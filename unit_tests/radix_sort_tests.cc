@@ -18,7 +18,9 @@
  */
 
 #include <algorithm>
+#include <memory>
 #include <random>
+#include <span>
 #include <vector>
 
 #include "../src/utils.h"
@@ -129,4 +131,40 @@ TEST(RADIX_SORT_TEST, UniformLong) {
 
   // Test that the checksum is the same
   ASSERT_EQ(cksm, get_checksum(arr));
-}
\ No newline at end of file
+}
+
+TEST(RADIX_SORT_TEST, UniformDoubleRawPointer) {
+  // Generate random input, and copy it to a buffer that is not a vector
+  auto arr = uniform_distr<double>(TEST_SIZE, -1, 1);
+  auto cksm = get_checksum(arr);
+  std::unique_ptr<double[]> buf(new double[arr.size()]);
+  std::copy(arr.begin(), arr.end(), buf.get());
+
+  // Sort the buffer in place, through raw pointers
+  radix_sort(buf.get(), buf.get() + arr.size());
+  std::copy(buf.get(), buf.get() + arr.size(), arr.begin());
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+}
+
+TEST(RADIX_SORT_TEST, UniformLongSpan) {
+  // Generate random input
+  auto arr = uniform_distr<long>(TEST_SIZE, -500000, 5000000);
+
+  // Calculate the checksum
+  auto cksm = get_checksum(arr);
+
+  // Sort through a span over the input
+  std::span<long> view(arr);
+  radix_sort(view.begin(), view.end());
+
+  // Test that it is sorted
+  ASSERT_TRUE(std::is_sorted(arr.begin(), arr.end()));
+
+  // Test that the checksum is the same
+  ASSERT_EQ(cksm, get_checksum(arr));
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/**
+ * @file test_resources.h
+ * @brief Memory resources shared by the unit tests that check where the
+ * library allocates its memory from
+ *
+ * @copyright Copyright (c) 2021 Ani Kristo (anikristo@gmail.com)
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+#include <memory_resource>
+
+#include "../include/utils.h"
+
+// Counts the bytes that are allocated from the upstream resource
+class counting_resource : public std::pmr::memory_resource {
+ public:
+  size_t allocated = 0;
+  size_t deallocated = 0;
+
+ protected:
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    allocated += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+    deallocated += bytes;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+};
+
+// Makes any allocation from the default or the scratch resource fail while it
+// is in scope, and restores the previous resources when it goes out of scope
+class null_default_resources {
+ public:
+  null_default_resources()
+      : prev_default(
+            std::pmr::set_default_resource(std::pmr::null_memory_resource())),
+        prev_scratch(learned_sort::utils::set_scratch_resource(
+            std::pmr::null_memory_resource())) {}
+
+  ~null_default_resources() {
+    learned_sort::utils::set_scratch_resource(prev_scratch);
+    std::pmr::set_default_resource(prev_default);
+  }
+
+  null_default_resources(const null_default_resources &) = delete;
+  null_default_resources &operator=(const null_default_resources &) = delete;
+
+ private:
+  std::pmr::memory_resource *prev_default;
+  std::pmr::memory_resource *prev_scratch;
+};